@@ -0,0 +1,262 @@
+/*
+ *	content-addressed backup store
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "errio.h"
+#include "fio.h"
+#include "bstore.h"
+
+#define BS_OBJECTS	".objects"
+#define BS_VERSIONS	".versions"
+#define BS_BUFSZ	0x10000
+
+// 64-bit FNV-1a hash of the contents of the file
+static bool bs_hash(int dfd, const char *file, uint64_t *hash) {
+	unsigned char buf[BS_BUFSZ];
+	uint64_t h = 0xcbf29ce484222325ULL;
+	ssize_t	n;
+	int		fd;
+
+	if ( (fd = openat(dfd, file, O_RDONLY | O_CLOEXEC)) < 0 )
+		return false;
+	while ( (n = read(fd, buf, sizeof(buf))) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			close(fd);
+			return false;
+			}
+		for ( ssize_t i = 0; i < n; i ++ ) {
+			h ^= buf[i];
+			h *= 0x100000001b3ULL;
+			}
+		}
+	close(fd);
+	*hash = h;
+	return true;
+	}
+
+// returns true if the two files have the same contents; 'b' is relative to 'dfd'
+static bool bs_same(const char *a, int dfd, const char *b) {
+	char	ba[BS_BUFSZ], bb[BS_BUFSZ];
+	ssize_t	na, nb;
+	int		fa, fb;
+	bool	rv = false;
+
+	if ( (fa = open(a, O_RDONLY | O_CLOEXEC)) < 0 )
+		return false;
+	if ( (fb = openat(dfd, b, O_RDONLY | O_CLOEXEC)) >= 0 ) {
+		do {
+			na = read(fa, ba, sizeof(ba));
+			nb = read(fb, bb, sizeof(bb));
+			rv = ( na == nb && na >= 0 && memcmp(ba, bb, na) == 0 );
+			} while ( rv && na > 0 );
+		close(fb);
+		}
+	close(fa);
+	return rv;
+	}
+
+// build the path root/dir/[section/]fname
+static void bs_path(char *buf, const char *root, const char *dir, const char *section, const char *fname) {
+	if ( *section )
+		snprintf(buf, PATH_MAX, "%s/%s%s/%s", root, dir, section, fname);
+	else
+		snprintf(buf, PATH_MAX, "%s/%s%s", root, dir, fname);
+	}
+
+// build the path of the object 'oname'
+static void bs_objpath(char *buf, const char *root, const char *oname) {
+	snprintf(buf, PATH_MAX, "%s/" BS_OBJECTS "/%.2s/%s", root, oname, oname + 2);
+	}
+
+// qsort callback
+static int bs_cmp(const void *va, const void *vb) {
+	return strcmp(*(const char **) va, *(const char **) vb);
+	}
+
+// returns the sorted (oldest first) table of versions in 'vdir' and their number
+static int bs_versions(const char *vdir, char ***table) {
+	DIR		*dir;
+	struct dirent *e;
+	int		count = 0, alloc = 16;
+	
+	*table = (char **) m_alloc(sizeof(char *) * alloc);
+	if ( (dir = opendir(vdir)) != NULL ) {
+		while ( (e = readdir(dir)) != NULL ) {
+			if ( strchr(e->d_name, '~') == NULL )
+				continue;
+			if ( count == alloc ) {
+				alloc *= 2;
+				*table = (char **) m_realloc(*table, sizeof(char *) * alloc);
+				}
+			(*table)[count ++] = strdup(e->d_name);
+			}
+		closedir(dir);
+		}
+	qsort(*table, count, sizeof(char *), bs_cmp);
+	return count;
+	}
+
+// free the table of versions
+static void bs_free_versions(char **table, int count) {
+	for ( int i = 0; i < count; i ++ )
+		m_free(table[i]);
+	m_free(table);
+	}
+
+// add the contents of 'file' to the objects (if not exists); returns its name in 'oname'
+static bool bs_object(const char *root, int dfd, const char *file, const struct stat *st, char *oname) {
+	char	obj[PATH_MAX], tmp[PATH_MAX];
+	uint64_t hash;
+	int		fd;
+
+	if ( !bs_hash(dfd, file, &hash) )
+		return false;
+	for ( int n = 0; n < 100; n ++ ) {
+		if ( n )
+			sprintf(oname, "%016llx-%lld.%d", (unsigned long long) hash, (long long) st->st_size, n);
+		else
+			sprintf(oname, "%016llx-%lld", (unsigned long long) hash, (long long) st->st_size);
+		bs_objpath(obj, root, oname);
+		if ( access(obj, F_OK) == 0 ) {
+			if ( bs_same(obj, dfd, file) )
+				return true;	// stored already
+			continue;			// hash collision
+			}
+
+		// new object
+		snprintf(tmp, PATH_MAX, "%s/" BS_OBJECTS "/%.2s", root, oname);
+		if ( !fio_mkdirs(tmp, 0700) )
+			return false;
+		snprintf(tmp, PATH_MAX, "%s.XXXXXX", obj);
+		if ( (fd = mkostemp(tmp, O_CLOEXEC)) < 0 )
+			return false;
+		close(fd);
+		if ( !fio_copyat(dfd, file, AT_FDCWD, tmp) ) {
+			unlink(tmp);
+			return false;
+			}
+		chmod(tmp, st->st_mode & 0444);
+		if ( link(tmp, obj) != 0 && errno != EEXIST ) {
+			unlink(tmp);
+			return false;
+			}
+		unlink(tmp);
+		if ( bs_same(obj, dfd, file) ) // EEXIST: created by another instance
+			return true;
+		}
+	errno = EEXIST;
+	return false;
+	}
+
+// replace 'path' by a hard-link to 'obj'
+static bool bs_relink(const char *obj, const char *path) {
+	char	tmp[PATH_MAX], *p;
+	
+	snprintf(tmp, PATH_MAX, "%s", path);
+	if ( (p = strrchr(tmp, '/')) != NULL ) {
+		*p = '\0';
+		if ( !fio_mkdirs(tmp, 0700) )
+			return false;
+		}
+	snprintf(tmp, PATH_MAX, "%s.%d~", path, (int) getpid());
+	unlink(tmp);
+	if ( link(obj, tmp) != 0 )
+		return false;
+	if ( rename(tmp, path) != 0 ) {
+		unlink(tmp);
+		return false;
+		}
+	return true;
+	}
+
+// store a version of the note-file 'file'
+bool bs_store(const char *root, const char *section, const char *fname, int dfd, const char *file, int keep) {
+	char	vdir[PATH_MAX], path[PATH_MAX], obj[PATH_MAX], oname[64], stamp[32];
+	struct stat st, vst;
+	struct timespec ts;
+	char	**table;
+	int		count, i;
+	bool	rv = false;
+
+	if ( fstatat(dfd, file, &st, 0) != 0 )
+		return false;
+	bs_path(vdir, root, BS_VERSIONS "/", section, fname);
+	if ( !fio_mkdirs(vdir, 0700) )
+		return false;
+	count = bs_versions(vdir, &table);
+
+	// not modified since the last version; no i/o at all
+	if ( count ) {
+		snprintf(path, PATH_MAX, "%s/%s", vdir, table[count - 1]);
+		if ( stat(path, &vst) == 0 && vst.st_size == st.st_size
+				&& vst.st_mtim.tv_sec == st.st_mtim.tv_sec && vst.st_mtim.tv_nsec == st.st_mtim.tv_nsec ) {
+			bs_free_versions(table, count);
+			return true;
+			}
+		}
+
+	if ( !bs_object(root, dfd, file, &st, oname) )
+		goto done;
+	bs_objpath(obj, root, oname);
+
+	// same contents as the last version
+	if ( count && strcmp(strchr(table[count - 1], '~') + 1, oname) == 0 ) {
+		rv = true;
+		goto done;
+		}
+
+	// new version
+	clock_gettime(CLOCK_REALTIME, &ts);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", gmtime(&ts.tv_sec)); // UTC, sorts across DST and zones
+	snprintf(path, PATH_MAX, "%s/%s.%09ld~%s", vdir, stamp, ts.tv_nsec, oname);
+	if ( link(obj, path) != 0 )
+		goto done;
+	bs_path(path, root, "", section, fname);
+	rv = bs_relink(obj, path);
+
+	// retention, remove the oldest versions and the objects without versions
+	bs_free_versions(table, count);
+	count = bs_versions(vdir, &table);
+	for ( i = 0; keep > 0 && i < count - keep; i ++ ) {
+		snprintf(path, PATH_MAX, "%s/%s", vdir, table[i]);
+		bs_objpath(obj, root, strchr(table[i], '~') + 1);
+		unlink(path);
+		if ( stat(obj, &st) == 0 && st.st_nlink <= 1 )
+			unlink(obj);
+		}
+
+done:
+	bs_free_versions(table, count);
+	return rv;
+	}
+
@@ -0,0 +1,51 @@
+/*
+ *	content-addressed backup store
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#if !defined(__BSTORE_H__)
+#define __BSTORE_H__
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ *	layout of the store 'root':
+ *
+ *	root/.objects/xx/hash-size					the contents, stored once (read-only)
+ *	root/.versions/[section/]file/stamp~object	one hard-link per version of the note
+ *	root/[section/]file							hard-link to the latest version
+ *
+ *	the hard-links are the reference count of the objects; an object
+ *	without versions is removed. the stamp is the UTC time, YYYYMMDD-HHMMSS.NS
+ */
+
+// store a version of the note-file 'file' (relative to the directory 'dfd' or AT_FDCWD)
+// as 'section/fname'; unchanged files are not stored again.
+// keeps the 'keep' newest versions (0 = all).
+bool bs_store(const char *root, const char *section, const char *fname, int dfd, const char *file, int keep);
+
+#if defined(__cplusplus)
+	}
+#endif
+
+#endif
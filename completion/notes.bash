@@ -0,0 +1,30 @@
+# bash completion for notes(1)
+# install as /usr/share/bash-completion/completions/notes
+
+_notes() {
+	local cur prev
+	cur="${COMP_WORDS[COMP_CWORD]}"
+	prev="${COMP_WORDS[COMP_CWORD-1]}"
+
+	case "$prev" in
+	-c|--rcfile)
+		COMPREPLY=( $(compgen -f -- "$cur") )
+		return ;;
+	-s|--section)
+		COMPREPLY=( $(compgen -W "$(notes --complete "$cur" 2>/dev/null | sed -n 's|/[^/]*$||p' | sort -u)" -- "$cur") )
+		return ;;
+	esac
+
+	if [[ "$cur" == -* ]]; then
+		COMPREPLY=( $(compgen -W "-a -a+ -l -f -0 -v -p -e -d -r -s -c -h
+			--add --append --list --files --null --json --view --print --edit --delete
+			--rename --restore --rcfile --section --all --onstart --onexit --daemon
+			--batch --complete --trace --help --version" -- "$cur") )
+		return
+	fi
+
+	local IFS=$'\n'
+	COMPREPLY=( $(notes --complete "$cur" 2>/dev/null) )
+}
+
+complete -F _notes notes
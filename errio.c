@@ -76,7 +76,7 @@ size_t _e_write(void *ptr, size_t size, size_t count, FILE *fp, const char *pf,
 
 size_t _e_read(void *ptr, size_t size, size_t count, FILE *fp, const char *pf, size_t pl) {
 	size_t n = fread(ptr, size, count, fp);
-	if ( n == 0 ) {
+	if ( n == 0 && ferror(fp) ) { // zero bytes at the end of file is not an error
 		int e = errno;
 		const char *s = strerror(e);
 		_panic(pf, pl, "Read error\n\terrno: (%d) %s", e, s);
@@ -31,7 +31,7 @@ extern "C" {
 // --------------------------------------------------------------------------------
 
 void _panic(const char *pf, size_t pl, const char *fmt, ...);
-#define panic(fmt,...) _panic(__FILE__, __LINE__, fmt, ...)
+#define panic(fmt,...) _panic(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
 // --------------------------------------------------------------------------------
 	
@@ -0,0 +1,262 @@
+/*
+ *	file i/o routines
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#if defined(__linux__)
+	#include <linux/fs.h>
+#endif
+
+#include "fio.h"
+
+#define FIO_CHUNK	0x40000000	// max bytes per system call
+#define FIO_BUFSZ	0x10000		// buffer of the read/write loop
+
+// errors that mean "not supported here, try the next method"
+static bool fio_unsupported(int e) {
+	return (e == ENOSYS || e == EXDEV || e == EINVAL || e == EOPNOTSUPP || e == ENOTTY || e == EBADF || e == EPERM);
+	}
+
+// read/write loop
+static ssize_t fio_rwcopy(int in, int out) {
+	char	buf[FIO_BUFSZ];
+	ssize_t	n, w, total = 0;
+
+	while ( (n = read(in, buf, sizeof(buf))) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			return -1;
+			}
+		for ( char *p = buf; n; p += w, n -= w, total += w ) {
+			if ( (w = write(out, p, n)) < 0 ) {
+				if ( errno == EINTR ) { w = 0; continue; }
+				return -1;
+				}
+			}
+		}
+	return total;
+	}
+
+// move the data of the pipe 'in' to 'out' in the kernel
+static ssize_t fio_splice(int in, int out) {
+	ssize_t	n, total = 0;
+
+	while ( (n = splice(in, NULL, out, NULL, FIO_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			if ( total == 0 && fio_unsupported(errno) ) return fio_rwcopy(in, out);
+			return -1;
+			}
+		total += n;
+		}
+	return total;
+	}
+
+// copy the contents of 'in' to 'out' from their current offsets
+ssize_t fio_copyfd(int in, int out, const struct stat *st) {
+	ssize_t	n, total = 0;
+	struct stat ost;
+
+	// pipes (stdin)
+	if ( st && S_ISFIFO(st->st_mode) )
+		return fio_splice(in, out);
+
+#if defined(FICLONE)
+	// reflink the whole file (btrfs, xfs); the offsets must be at the beginning
+	// and 'out' must be empty, the clone replaces its contents
+	if ( st && S_ISREG(st->st_mode) && lseek(in, 0, SEEK_CUR) == 0 && lseek(out, 0, SEEK_CUR) == 0
+			&& !(fcntl(out, F_GETFL) & O_APPEND) && fstat(out, &ost) == 0 && ost.st_size == 0 ) {
+		if ( ioctl(out, FICLONE, in) == 0 ) {
+			lseek(in, st->st_size, SEEK_SET);
+			lseek(out, st->st_size, SEEK_SET);
+			return st->st_size;
+			}
+		}
+#endif
+
+	// in-kernel copy
+	while ( (n = copy_file_range(in, NULL, out, NULL, FIO_CHUNK, 0)) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			if ( total == 0 && fio_unsupported(errno) ) break;
+			return -1;
+			}
+		total += n;
+		}
+	if ( n == 0 )
+		return total;
+
+	// in-kernel copy, older kernels
+	while ( (n = sendfile(out, in, NULL, FIO_CHUNK)) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			if ( total == 0 && fio_unsupported(errno) ) break;
+			return -1;
+			}
+		total += n;
+		}
+	if ( n == 0 )
+		return total;
+
+	// user-space copy
+	return fio_rwcopy(in, out);
+	}
+
+// copy the contents, the mode and the times of 'in' to 'out'
+static bool fio_copyattr(int in, int out, const struct stat *st) {
+	if ( fio_copyfd(in, out, st) < 0 )
+		return false;
+	struct timespec ts[2] = { st->st_atim, st->st_mtim };
+	fchmod(out, st->st_mode & 07777);
+	futimens(out, ts);
+	return true;
+	}
+
+// copy file 'src' (relative to 'sfd') to 'trg' (relative to 'tfd')
+bool fio_copyat(int sfd, const char *src, int tfd, const char *trg) {
+	struct stat st;
+	int		in, out, e;
+	bool	rv = false;
+
+	if ( (in = openat(sfd, src, O_RDONLY | O_CLOEXEC)) < 0 )
+		return false;
+	if ( fstat(in, &st) == 0 ) {
+		if ( (out = openat(tfd, trg, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777)) >= 0 ) {
+			rv = fio_copyattr(in, out, &st);
+			e = errno;
+			if ( close(out) != 0 && rv ) { e = errno; rv = false; }
+			errno = e;
+			}
+		}
+	e = errno;
+	close(in);
+	errno = e;
+	return rv;
+	}
+
+// copy file 'src' to 'trg', the mode and the modification time are preserved
+bool fio_copy(const char *src, const char *trg) {
+	return fio_copyat(AT_FDCWD, src, AT_FDCWD, trg);
+	}
+
+// creates a new file relative to 'dfd'; the last six characters of 'tmpl' must be XXXXXX
+int fio_mkstempat(int dfd, char *tmpl) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	char	*x = tmpl + strlen(tmpl) - 6;
+	unsigned v = (unsigned) getpid() ^ (unsigned) time(NULL);
+	int		fd;
+
+	for ( int tries = 0; tries < 100; tries ++ ) {
+		for ( int i = 0; i < 6; i ++ ) {
+			v = v * 1103515245 + 12345 + tries;
+			x[i] = letters[(v >> 16) % (sizeof(letters) - 1)];
+			}
+		if ( (fd = openat(dfd, tmpl, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600)) >= 0 || errno != EEXIST )
+			return fd;
+		}
+	return -1;
+	}
+
+// move 'src' to another filesystem; the data are written to a temporary
+// file in the directory of 'trg' which is linked to 'trg' when completed
+static bool fio_xmove(int sfd, const char *src, int tfd, const char *trg) {
+	char	tmp[PATH_MAX];
+	const char *p = strrchr(trg, '/');
+	struct stat st;
+	int		in, out, e;
+	bool	rv = false;
+
+	p = ( p ) ? p + 1 : trg; // in the directory of 'trg'
+	if ( snprintf(tmp, sizeof(tmp), "%.*s" FIO_TMP_PREFIX "XXXXXX", (int) (p - trg), trg) >= (int) sizeof(tmp) ) {
+		errno = ENAMETOOLONG;
+		return false;
+		}
+	if ( (in = openat(sfd, src, O_RDONLY | O_CLOEXEC)) < 0 )
+		return false;
+	if ( fstat(in, &st) == 0 && (out = fio_mkstempat(tfd, tmp)) >= 0 ) {
+		rv = fio_copyattr(in, out, &st) && fsync(out) == 0;
+		e = errno;
+		if ( close(out) != 0 && rv ) { e = errno; rv = false; }
+		if ( rv && linkat(tfd, tmp, tfd, trg, 0) != 0 ) { e = errno; rv = false; } // fails if 'trg' exists
+		unlinkat(tfd, tmp, 0);
+		if ( rv )
+			unlinkat(sfd, src, 0);
+		errno = e;
+		}
+	e = errno;
+	close(in);
+	errno = e;
+	return rv;
+	}
+
+// rename 'src' (relative to 'sfd') to 'trg' (relative to 'tfd') without replacing an existing 'trg'
+bool fio_renameat(int sfd, const char *src, int tfd, const char *trg) {
+	if ( renameat2(sfd, src, tfd, trg, RENAME_NOREPLACE) == 0 )
+		return true;
+	switch ( errno ) {
+	case EXDEV:
+		return fio_xmove(sfd, src, tfd, trg);
+	case ENOSYS: case EINVAL: // RENAME_NOREPLACE is not supported by the filesystem
+		if ( linkat(sfd, src, tfd, trg, 0) == 0 )
+			return (unlinkat(sfd, src, 0) == 0);
+		if ( errno == EEXIST )
+			return false;
+		if ( faccessat(tfd, trg, F_OK, 0) == 0 ) {
+			errno = EEXIST;
+			return false;
+			}
+		return (renameat(sfd, src, tfd, trg) == 0);
+		}
+	return false;
+	}
+
+// rename 'src' to 'trg' without replacing an existing 'trg' (EEXIST)
+bool fio_rename(const char *src, const char *trg) {
+	return fio_renameat(AT_FDCWD, src, AT_FDCWD, trg);
+	}
+
+// create directory 'path' and its parents (mkdir -p)
+bool fio_mkdirs(const char *path, mode_t mode) {
+	char	buf[PATH_MAX], *p;
+	
+	if ( snprintf(buf, sizeof(buf), "%s", path) >= (int) sizeof(buf) ) {
+		errno = ENAMETOOLONG;
+		return false;
+		}
+	for ( p = buf + 1; *p; p ++ ) {
+		if ( *p == '/' ) {
+			*p = '\0';
+			if ( mkdir(buf, mode) != 0 && errno != EEXIST )
+				return false;
+			*p = '/';
+			}
+		}
+	return ( mkdir(buf, mode) == 0 || errno == EEXIST );
+	}
+
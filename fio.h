@@ -0,0 +1,68 @@
+/*
+ *	file i/o routines
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#if !defined(__FIO_H__)
+#define __FIO_H__
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// --------------------------------------------------------------------------------
+
+// copy the contents of 'in' to 'out' from their current offsets;
+// tries reflink (FICLONE), copy_file_range, sendfile and at last read/write;
+// pipes are moved with splice.
+// 'st' is the stat of 'in' or NULL. returns the bytes copied or -1 on error.
+ssize_t fio_copyfd(int in, int out, const struct stat *st);
+
+// copy file 'src' to 'trg', the mode and the modification time are preserved
+bool fio_copy(const char *src, const char *trg);
+bool fio_copyat(int sfd, const char *src, int tfd, const char *trg);
+
+// create a new file relative to the directory 'dfd' (mkostemp);
+// the last six characters of 'tmpl' must be XXXXXX and are replaced.
+int fio_mkstempat(int dfd, char *tmpl);
+
+// the prefix of the temporary files of the writers and the moves, so
+// the directory scans can skip them
+#define FIO_TMP_PREFIX	".fio-tmp."
+
+// rename 'src' to 'trg'; it fails with EEXIST if 'trg' exists.
+// across filesystems it copies to a temporary file and links it to 'trg',
+// so 'trg' is never a partial file.
+bool fio_rename(const char *src, const char *trg);
+bool fio_renameat(int sfd, const char *src, int tfd, const char *trg);
+
+// create directory 'path' and its parents (mkdir -p)
+bool fio_mkdirs(const char *path, mode_t mode);
+
+// --------------------------------------------------------------------------------
+
+#if defined(__cplusplus)
+	}
+#endif
+
+#endif
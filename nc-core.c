@@ -123,99 +123,257 @@ void nc_unsetcolor(WINDOW *win, int fg, int bg)	{ wattroff(win, COLOR_PAIR(nc_ge
 void nc_setpair  (WINDOW *win, int pair) { wattron  (win, COLOR_PAIR(pair)); }
 void nc_unsetpair(WINDOW *win, int pair) { wattroff (win, COLOR_PAIR(pair)); }
 
-static void nc_hclr(WINDOW *win, int mode, char fg, char bg) {
-	if ( mode ) 
-		nc_setvgacolor(win, c2dec(fg), c2dec(bg)); 
-	else
-		nc_unsetvgacolor(win, c2dec(fg), c2dec(bg)); 
+#define	CSTACK_MAX	16
+static int cstack[CSTACK_MAX], csp;
+
+// append a span to the compiled format
+static nc_span_t *nc_fmt_span(nc_fmt_t *f, int op, int val) {
+	if ( f->count == f->alloc ) {
+		f->alloc += 16;
+		f->span = (nc_span_t *) m_realloc(f->span, sizeof(nc_span_t) * f->alloc);
+		}
+	nc_span_t *sp = &f->span[f->count ++];
+	sp->op  = op;
+	sp->val = val;
+	sp->ofs = f->tlen;
+	sp->len = 0;
+	return sp;
 	}
-static void nc_hpair(WINDOW *win, int mode, char d1, char d0) {
-	if ( mode )
-		wattron (win, COLOR_PAIR((c2dec(d1) << 4) | c2dec(d0)));
-	else
-		wattroff(win, COLOR_PAIR((c2dec(d1) << 4) | c2dec(d0)));
+
+// append text to the text buffer of the compiled format
+static void nc_fmt_text(nc_fmt_t *f, const char *src, int len) {
+	if ( f->tlen + len + 1 > f->talloc ) {
+		f->talloc = f->tlen + len + 64;
+		f->text = (char *) m_realloc(f->text, f->talloc);
+		}
+	memcpy(f->text + f->tlen, src, len);
+	f->tlen += len;
+	f->text[f->tlen] = '\0';
 	}
 
-// print with codes/colors
-#define ccase(c,a) \
-	case (c): { if ( *p == toupper(c) ) wattron(win, (a)); else wattroff(win, (a)); break; }
+// append literal text; merges with the previous literal run
+static void nc_fmt_literal(nc_fmt_t *f, const char *src, int len) {
+	nc_span_t *sp = ( f->count ) ? &f->span[f->count - 1] : NULL;
+	if ( sp == NULL || sp->op != NC_SPAN_TEXT || sp->ofs + sp->len != f->tlen )
+		sp = nc_fmt_span(f, NC_SPAN_TEXT, 0);
+	nc_fmt_text(f, src, len);
+	sp->len += len;
+	}
 
-#define	CSTACK_MAX	16
-static int cstack[CSTACK_MAX], csp;
+// parse a printf conversion specification; returns the end of it or NULL
+static const char *nc_fmt_conv(nc_fmt_t *f, const char *p) {
+	const char *s = p ++;
+	int		type, lmod = 0;
 
-// ncurses printf with codes/colors
-// $ = escape character, $$ = print dolar
-// $B,$U,$R,$D = enable bold, underline, reverse, dim
-// $b,$u,$r,$d = disable bold, underline, reverse, dim
-// $Cxx = set VGA colors, x is hexadecimal digit, both digits represents VGA
-// text mode attributes (blink|intensity-background-foreground)
-//
-void nc_mvwprintf(WINDOW *win, int y, int x, const char *fmt, ...) {
-	char	msg[LINE_MAX], buf[LINE_MAX];
-	char	*p = msg, *b = buf;
+	while ( *p && strchr("-+ #0", *p) )	p ++;
+	while ( isdigit(*p) )	p ++;
+	if ( *p == '.' ) { p ++; while ( isdigit(*p) ) p ++; }
+	while ( *p && strchr("hlLqjzt", *p) ) {
+		if ( *p == 'l' )	lmod ++;
+		else if ( *p == 'L' || *p == 'q' || *p == 'j' )	lmod = 2;
+		else if ( *p == 'z' || *p == 't' )	lmod = 1;
+		p ++;
+		}
+	switch ( *p ) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		type = ( lmod == 0 ) ? NC_ARG_INT : (( lmod == 1 ) ? NC_ARG_LONG : NC_ARG_LLONG);
+		break;
+	case 'c':	type = NC_ARG_INT; break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		type = NC_ARG_DOUBLE; break;
+	case 's':	type = NC_ARG_STR; break;
+	case 'p':	type = NC_ARG_PTR; break;
+	default:	return NULL; // not supported (i.e. '*' width)
+		}
+	p ++;
+	nc_span_t *sp = nc_fmt_span(f, NC_SPAN_ARG, type);
+	sp->len = p - s;
+	nc_fmt_text(f, s, sp->len);
+	f->tlen ++; // keep the '\0', the spec is used as format string
+	return p;
+	}
 
-	va_list ap;
-	va_start(ap, fmt);
-	vsnprintf(msg, LINE_MAX, fmt, ap);
-	va_end(ap);
+// parses 'src' and appends it to 'f'; if 'args' is false the '%' is a normal character
+static void nc_fmt_parse(nc_fmt_t *f, const char *src, bool args) {
+	const char *p = src, *e;
+	int		c;
 
-	if ( y >= 0 && x >= 0 )
-		wmove(win, y, x);
-	else if ( y >= 0 )
-		wmove(win, y, getcurx(win));
-	else if ( x >= 0 )
-		wmove(win, getcury(win), x);
-		
 	while ( *p ) {
 		switch ( *p ) {
 		case '$':
 			p ++;
-			if ( b > buf ) { *b = '\0'; waddstr(win, buf); b = buf; } // flash buffer
-			switch ( tolower(*p) ) {
-			ccase('b', A_BOLD)
-			ccase('r', A_REVERSE)
-			ccase('d', A_DIM)
-			ccase('u', A_UNDERLINE)
+			c = *p;
+			switch ( tolower(c) ) {
+			case 'b': nc_fmt_span(f, (c == 'B') ? NC_SPAN_ATTRON : NC_SPAN_ATTROFF, A_BOLD); break;
+			case 'r': nc_fmt_span(f, (c == 'R') ? NC_SPAN_ATTRON : NC_SPAN_ATTROFF, A_REVERSE); break;
+			case 'd': nc_fmt_span(f, (c == 'D') ? NC_SPAN_ATTRON : NC_SPAN_ATTROFF, A_DIM); break;
+			case 'u': nc_fmt_span(f, (c == 'U') ? NC_SPAN_ATTRON : NC_SPAN_ATTROFF, A_UNDERLINE); break;
 			case 'p': // vga color
 				p ++;
 				if ( isxdigit(*p) && isxdigit(p[1]) ) {
-					if ( has_colors() )
-						nc_hclr(win, true, p[1], p[0]);
+					nc_fmt_span(f, NC_SPAN_COLOR, (c2dec(*p) << 4) | c2dec(p[1]));
 					p ++;
 					}
 				break;
 			case 'c': // vga color
-				if ( *p == toupper(*p) ) {
+				if ( c == 'C' ) {
 					p ++;
 					if ( isxdigit(*p) && isxdigit(p[1]) ) {
-						if ( csp < CSTACK_MAX ) {
-							if ( has_colors() )
-								nc_hclr(win, true, p[1], p[0]);
-							cstack[csp++] = (p[1] << 8) | p[0];
-							}
+						nc_fmt_span(f, NC_SPAN_PUSH, (c2dec(*p) << 4) | c2dec(p[1]));
 						p ++;
 						}
 					}
-				else { // pop previous colors
-					if ( csp ) {
-						int c = cstack[--csp];
-						if ( has_colors() )
-							nc_hclr(win, false, c >> 8, c & 0xFF);
-						}
-					}
+				else // pop previous colors
+					nc_fmt_span(f, NC_SPAN_POP, 0);
 				break;
+			case '\0':
+				continue;
 			default: // not recognized
-				*b ++ = *p;
+				nc_fmt_literal(f, p, 1);
 				}
+			p ++;
+			break;
+		case '%':
+			if ( args ) {
+				if ( p[1] == '%' ) {
+					nc_fmt_literal(f, p, 1);
+					p += 2;
+					break;
+					}
+				if ( (e = nc_fmt_conv(f, p)) != NULL ) {
+					p = e;
+					break;
+					}
+				}
+			nc_fmt_literal(f, p ++, 1);
 			break;
 		default:
-			*b ++ = *p;
+			for ( e = p; *e && *e != '$' && *e != '%'; e ++ );
+			nc_fmt_literal(f, p, e - p);
+			p = e;
 			}
-		p ++;
 		}
-	if ( b > buf ) { *b = '\0'; waddstr(win, buf); b = buf; } // flash buffer
 	}
-#undef ccase
+
+// compile a format string with "escape-codes" (see nc_mvwprintf)
+// the printf conversions are stored as argument slots; the width
+// and precision must be literals ('*' is not supported).
+nc_fmt_t *nc_compile(const char *fmt) {
+	nc_fmt_t *f = (nc_fmt_t *) m_alloc(sizeof(nc_fmt_t));
+	memset(f, 0, sizeof(nc_fmt_t));
+	nc_fmt_parse(f, fmt, true);
+	return f;
+	}
+
+// free a compiled format, returns always NULL
+nc_fmt_t *nc_fmt_free(nc_fmt_t *f) {
+	if ( f ) {
+		if ( f->span ) m_free(f->span);
+		if ( f->text ) m_free(f->text);
+		m_free(f);
+		}
+	return NULL;
+	}
+
+// render a compiled format; the arguments are printed as they are, no escape-codes
+static void nc_fmt_render(WINDOW *win, const nc_fmt_t *f, va_list *ap) {
+	char	buf[LINE_MAX];
+	const char *s;
+	
+	for ( int i = 0; i < f->count; i ++ ) {
+		const nc_span_t *sp = &f->span[i];
+		switch ( sp->op ) {
+		case NC_SPAN_TEXT:		waddnstr(win, f->text + sp->ofs, sp->len); break;
+		case NC_SPAN_ATTRON:	wattron (win, sp->val); break;
+		case NC_SPAN_ATTROFF:	wattroff(win, sp->val); break;
+		case NC_SPAN_COLOR:
+			if ( has_colors() )
+				nc_setvgacolor(win, sp->val & 0xF, sp->val >> 4);
+			break;
+		case NC_SPAN_PUSH:
+			if ( csp < CSTACK_MAX ) {
+				if ( has_colors() )
+					nc_setvgacolor(win, sp->val & 0xF, sp->val >> 4);
+				cstack[csp++] = sp->val;
+				}
+			break;
+		case NC_SPAN_POP:
+			if ( csp ) {
+				int c = cstack[--csp];
+				if ( has_colors() )
+					nc_unsetvgacolor(win, c & 0xF, c >> 4);
+				}
+			break;
+		case NC_SPAN_ARG:
+			s = f->text + sp->ofs;
+			switch ( sp->val ) {
+			case NC_ARG_STR: {
+				const char *arg = va_arg(*ap, const char *);
+				if ( arg == NULL )
+					arg = "(null)";
+				if ( sp->len == 2 ) { // plain %s
+					waddstr(win, arg);
+					continue;
+					}
+				snprintf(buf, LINE_MAX, s, arg);
+				break;
+				}
+			case NC_ARG_INT:	snprintf(buf, LINE_MAX, s, va_arg(*ap, int)); break;
+			case NC_ARG_LONG:	snprintf(buf, LINE_MAX, s, va_arg(*ap, long)); break;
+			case NC_ARG_LLONG:	snprintf(buf, LINE_MAX, s, va_arg(*ap, long long)); break;
+			case NC_ARG_DOUBLE:	snprintf(buf, LINE_MAX, s, va_arg(*ap, double)); break;
+			case NC_ARG_PTR:	snprintf(buf, LINE_MAX, s, va_arg(*ap, void *)); break;
+				}
+			waddstr(win, buf);
+			break;
+			}
+		}
+	}
+
+// move the cursor as nc_mvwprintf does
+static void nc_wmoveto(WINDOW *win, int y, int x) {
+	if ( y >= 0 && x >= 0 )
+		wmove(win, y, x);
+	else if ( y >= 0 )
+		wmove(win, y, getcurx(win));
+	else if ( x >= 0 )
+		wmove(win, getcury(win), x);
+	}
+
+// print a compiled format
+void nc_mvwputf(WINDOW *win, int y, int x, const nc_fmt_t *f, ...) {
+	va_list ap;
+	nc_wmoveto(win, y, x);
+	va_start(ap, f);
+	nc_fmt_render(win, f, &ap);
+	va_end(ap);
+	}
+
+// ncurses printf with codes/colors
+// $ = escape character, $$ = print dolar
+// $B,$U,$R,$D = enable bold, underline, reverse, dim
+// $b,$u,$r,$d = disable bold, underline, reverse, dim
+// $Cxx = set VGA colors, x is hexadecimal digit, both digits represents VGA
+// text mode attributes (blink|intensity-background-foreground)
+// $cxx = restore previous colors
+// $pxx = set VGA colors, without storing them
+//
+// the escape-codes are interpreted after the formatting, that means inside
+// the arguments too; use nc_compile/nc_mvwputf for frequently used formats.
+void nc_mvwprintf(WINDOW *win, int y, int x, const char *fmt, ...) {
+	static nc_fmt_t f;
+	char	msg[LINE_MAX];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(msg, LINE_MAX, fmt, ap);
+	va_end(ap);
+
+	nc_wmoveto(win, y, x);
+	f.count = f.tlen = 0;
+	nc_fmt_parse(&f, msg, false);
+	nc_fmt_render(win, &f, NULL);
+	}
 
 #define nc_wprintf(w,f,...)	nc_mvwprintf(w,-1,-1,f,__VA_ARGS__)
 #define nc_printf(f,...)	nc_mvwprintf(stdscr,-1,-1,f,__VA_ARGS__)
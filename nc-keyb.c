@@ -24,55 +24,123 @@
 
 //
 #define KEYMAPS_MAX		8
-typedef struct { char name[32]; list_t map; } keymap_t;
-static keymap_t keymaps[KEYMAPS_MAX];
-static int kmap_count = 0;
+#define KEYMAP_DIRECT	0x400	// ncurses key codes and KEY_ALT_BIT are indexed directly
+#define KEYMAP_HASH		64		// initial size of the hash table of the rest codes (power of 2)
 typedef struct { int key, pid; } pkey_t;
+struct nc_keymap_s {
+	char	name[32];
+	list_t	map;					// the bindings in order of definition
+	int		direct[KEYMAP_DIRECT];	// key -> last defined pid, 0 = not defined
+	pkey_t	*hash;					// key >= KEYMAP_DIRECT, open addressing
+	int		hash_size, hash_count;
+	};
+static nc_keymap_t keymaps[KEYMAPS_MAX];
+static int kmap_count = 0;
 
-// returns a pointer to keymap list
-static list_t *getkeymap(const char *name) {
+// returns the keymap handle, creates it if not exists
+nc_keymap_t *nc_keymap(const char *name) {
 	for ( int i = 0; i < kmap_count; i ++ )
 		if ( strncmp(keymaps[i].name, name, 32) == 0 )
-			return &keymaps[i].map;
+			return &keymaps[i];
+	if ( kmap_count == KEYMAPS_MAX )
+		panic("too many keymaps (%d)", KEYMAPS_MAX);
 	strncpy(keymaps[kmap_count].name, name, 32);
-	return &keymaps[kmap_count++].map;
+	return &keymaps[kmap_count++];
+	}
+
+// returns the hash slot of the key; the slot is free (pid = 0) if the key is not in
+static pkey_t *keymap_slot(nc_keymap_t *km, int key) {
+	unsigned h = ((unsigned) key * 2654435761u) & (km->hash_size - 1);
+	while ( km->hash[h].pid && km->hash[h].key != key )
+		h = (h + 1) & (km->hash_size - 1);
+	return &km->hash[h];
+	}
+
+// rebuild the hash table from the bindings list; used when a code >= KEYMAP_DIRECT deleted
+static void keymap_rehash(nc_keymap_t *km, int size) {
+	if ( km->hash )
+		m_free(km->hash);
+	km->hash_size = size;
+	km->hash_count = 0;
+	km->hash = (pkey_t *) m_alloc(sizeof(pkey_t) * size);
+	memset(km->hash, 0, sizeof(pkey_t) * size);
+	for ( list_node_t *cur = km->map.head; cur; cur = cur->next ) {
+		pkey_t *pk = (pkey_t *) cur->data, *slot;
+		if ( pk->key >= 0 && pk->key < KEYMAP_DIRECT ) // in the direct table
+			continue;
+		slot = keymap_slot(km, pk->key);
+		if ( !slot->pid ) km->hash_count ++;
+		*slot = *pk;
+		}
+	}
+
+// store the binding to the lookup tables; the last defined wins
+static void keymap_index(nc_keymap_t *km, const pkey_t *pk) {
+	if ( pk->key >= 0 && pk->key < KEYMAP_DIRECT )
+		km->direct[pk->key] = pk->pid;
+	else {
+		if ( km->hash == NULL || (km->hash_count + 1) * 2 > km->hash_size )
+			keymap_rehash(km, (km->hash_size) ? km->hash_size * 2 : KEYMAP_HASH);
+		pkey_t *slot = keymap_slot(km, pk->key);
+		if ( !slot->pid ) km->hash_count ++;
+		*slot = *pk;
+		}
+	}
+
+// add a binding to the keymap
+static void keymap_bind(nc_keymap_t *km, int key, int pid) {
+	pkey_t	pk = { key, pid };
+	list_add(&km->map, &pk, sizeof(pkey_t));
+	keymap_index(km, &pk);
 	}
 
 //
 void nc_addkey(const char *map_name, int pkey, int key) {
-	list_t *map = getkeymap(map_name);
-	pkey_t	pk = { key, KEY_PRG(pkey) };
-	list_add(map, &pk, sizeof(pkey_t));
+	keymap_bind(nc_keymap(map_name), key, KEY_PRG(pkey));
 	}
 
 //
 void nc_delkey(const char *map_name, int key) {
-	list_t *map = getkeymap(map_name);
-	list_node_t	*cur = map->head, *next;
+	nc_keymap_t *km = nc_keymap(map_name);
+	list_node_t	*cur = km->map.head, *next;
 	
 	while ( cur ) {
 		int c = ((pkey_t *) cur->data)->key;
 		next = cur->next;
 		if ( c == key )
-			list_delete(map, cur); // delete this
+			list_delete(&km->map, cur); // delete this
 		cur = next;
 		}
+	if ( key >= 0 && key < KEYMAP_DIRECT )
+		km->direct[key] = 0;
+	else if ( km->hash )
+		keymap_rehash(km, km->hash_size);
+	}
+
+// removes the bindings of all keymaps; the keymaps remain valid
+void nc_clearkeys() {
+	for ( int i = 0; i < kmap_count; i ++ ) {
+		nc_keymap_t *km = &keymaps[i];
+		list_clear(&km->map);
+		memset(km->direct, 0, sizeof(km->direct));
+		if ( km->hash )
+			m_free(km->hash);
+		km->hash = NULL;
+		km->hash_size = km->hash_count = 0;
+		}
 	}
 
 // assigns additional keys to procedural key pkey
 void nc_setkey(const char *map_name, int pkey, ...) {
 	va_list	ap;
-	pkey_t	pk = { pkey, KEY_PRG(pkey) };
 	int		c;
 	
-	list_t *map = getkeymap(map_name);
-	list_add(map, &pk, sizeof(pkey_t));
+	nc_keymap_t *km = nc_keymap(map_name);
+	keymap_bind(km, pkey, KEY_PRG(pkey));
 	
 	va_start(ap, pkey);
-	while ( (c = va_arg(ap, int)) != 0 ) {
-		pk.key = c;
-		list_add(map, &pk, sizeof(pkey_t));
-		}
+	while ( (c = va_arg(ap, int)) != 0 )
+		keymap_bind(km, c, KEY_PRG(pkey));
 	va_end(ap);
 	}
 
@@ -93,19 +161,19 @@ void nc_use_default_keymap() {
 	}
 
 // returns the last defined KEY_PRG code of the 'key'
-int	nc_getprg(const char *map_name, int key) {
-	list_t *map = getkeymap(map_name);
-	list_node_t *cur = map->head;
-	int       pid = KEY_PRG(key); // default: return the same key
-	pkey_t    *pk;
+int	nc_mapprg(nc_keymap_t *km, int key) {
+	int	pid;
 	
-	while ( cur ) {
-		pk = (pkey_t *) cur->data;
-		if ( pk->key == key )
-			pid = pk->pid;	// get the last defined
-		cur = cur->next;
-		}
-	return pid;
+	if ( key >= 0 && key < KEYMAP_DIRECT )
+		pid = km->direct[key];
+	else
+		pid = ( km->hash ) ? keymap_slot(km, key)->pid : 0;
+	return ( pid ) ? pid : KEY_PRG(key); // default: return the same key
+	}
+
+// same as nc_mapprg but by the name of the keymap
+int	nc_getprg(const char *map_name, int key) {
+	return nc_mapprg(nc_keymap(map_name), key);
 	}
 
 // returns the key-code from a string or <0 on error
@@ -24,23 +24,88 @@
 #include <wctype.h>
 #include "nc-plus.h"
 
+#define TYPEAHEAD_MAX	64
+
+// first-character index; sorted by character then by item index
+typedef struct { wchar_t wc; int idx; } fcidx_t;
+
+// qsort callback
+static int fcidx_cmp(const void *va, const void *vb) {
+	const fcidx_t *a = (const fcidx_t *) va;
+	const fcidx_t *b = (const fcidx_t *) vb;
+	if ( a->wc != b->wc )
+		return ( a->wc < b->wc ) ? -1 : 1;
+	return a->idx - b->idx;
+	}
+
+// returns the first entry of the index with character 'wc' or -1
+static int fcidx_find(const fcidx_t *index, int count, wchar_t wc) {
+	int lo = 0, hi = count;
+	while ( lo < hi ) {
+		int mid = (lo + hi) / 2;
+		if ( index[mid].wc < wc ) lo = mid + 1; else hi = mid;
+		}
+	return ( lo < count && index[lo].wc == wc ) ? lo : -1;
+	}
+
+// returns true if the string 'str' begins with 'prefix' (case insensitive)
+static bool u8prefix(const char *str, const wchar_t *prefix, int len) {
+	mbstate_t	st;
+	wchar_t		wc;
+	size_t		n;
+
+	memset(&st, 0, sizeof(st));
+	for ( int i = 0; i < len; i ++ ) {
+		n = mbrtowc(&wc, str, MB_CUR_MAX, &st);
+		if ( n == 0 || n == (size_t) -1 || n == (size_t) -2 )
+			return false;
+		if ( towupper(wc) != prefix[i] )
+			return false;
+		str += n;
+		}
+	return true;
+	}
+
+// type-ahead; returns the next item after 'pos' (or 'pos' itself if 'stay') that
+// begins with 'typed', or -1
+static int lb_typeahead(const char **items, const fcidx_t *index, int lines, int pos,
+		const wchar_t *typed, int tlen, bool stay) {
+	int first = fcidx_find(index, lines, typed[0]), i, found = -1;
+	if ( first < 0 )
+		return -1;
+	for ( i = first; i < lines && index[i].wc == typed[0]; i ++ ) {
+		if ( !u8prefix(items[index[i].idx], typed, tlen) )
+			continue;
+		if ( index[i].idx > pos || (stay && index[i].idx == pos) )
+			return index[i].idx;
+		if ( found < 0 )	// wrap around
+			found = index[i].idx;
+		}
+	return found;
+	}
+
 /*
  * returns the selected item index or -1
  */
 int nc_listbox(const char *title, const char **items, int defidx) {
 	int		x, y, dx, dy, c, exf = 0;
-	int		i, lines, wlines, offset;
-	int		maxlen = 0, maxcols = 0, pos = 0;
-	bool	found;
+	int		i, lines, wlines, rows, offset;
+	int		maxcols = 0, pos = 0;
+	int		tlen = 0, found;
+	wchar_t	typed[TYPEAHEAD_MAX];
+	fcidx_t	*index;
 	
-	for ( lines = 0; items[lines]; lines ++ ) {
-		maxlen = MAX(maxlen, strlen(items[lines])); 
-		maxcols = MAX(maxcols, u8width(items[lines])); 
+	// widths and first-character index, computed once
+	for ( lines = 0; items[lines]; lines ++ );
+	index = (fcidx_t *) m_alloc(sizeof(fcidx_t) * (lines + 1));
+	for ( i = 0; i < lines; i ++ ) {
+		maxcols = MAX(maxcols, u8width(items[i])); 
+		index[i].wc  = towupper(u8towc(items[i]));
+		index[i].idx = i;
 		}
-	if ( title ) {
-		maxlen = MAX(maxlen, strlen(title)); 
+	qsort(index, lines, sizeof(fcidx_t), fcidx_cmp);
+	if ( title )
 		maxcols = MAX(maxcols, u8width(title));
-		}
 	if ( defidx < 0 || defidx >= lines )
 		defidx = 0;
 	
@@ -51,23 +116,24 @@ int nc_listbox(const char *title, const char **items, int defidx) {
 	y = LINES / 2 - dy / 2;
 	WINDOW	*wout = newwin(dy, dx, y, x);
 	keypad(wout, TRUE);
+	box(wout, 0, 0);
+	if ( title ) nc_wtitle(wout, title, 2);
+	wrefresh(wout);
 	
 	WINDOW	*w = subwin(wout, dy - 2, dx - 4, y + 1, x + 2);
 	keypad(w, TRUE);
 	wlines = dy - 4;
+	rows = getmaxy(w);
 
 	offset = 0;
 	pos = defidx;
 	do {
+		// draw only the visible items
 		if ( offset > pos )	offset = pos;
-		if ( offset + lines < pos )	offset = pos - lines;
+		if ( pos >= offset + rows )	offset = pos - rows + 1;
 		if ( offset < 0 ) offset = 0;
-		werase(wout);
-		box(wout, 0, 0);
-		if ( title ) nc_wtitle(wout, title, 2);
-		wrefresh(wout);
 		werase(w);
-		for ( i = offset, y = 0; i < lines; i ++, y ++ ) {
+		for ( i = offset, y = 0; i < lines && y < rows; i ++, y ++ ) {
 			if ( i == pos ) wattron(w, A_REVERSE);
 			mvwhline(w, y, 0, ' ', getmaxx(w));
 			mvwprintw(w, y, 1, "%s", items[i]);
@@ -103,10 +169,21 @@ int nc_listbox(const char *title, const char **items, int defidx) {
 		case KEY_HOME:	offset = pos = 0; break;
 		case '\005':
 		case KEY_END:	pos = lines - 1; break;
+		case '\010': case '\x7f':
+		case KEY_BACKSPACE: // shorten the type-ahead string
+			if ( tlen > 1 ) {
+				tlen --;
+				if ( (found = lb_typeahead(items, index, lines, -1, typed, tlen, false)) >= 0 )
+					pos = found;
+				}
+			else
+				tlen = 0;
+			continue;
 		default: {
-				found = false;
-				wchar_t	wi, wc;
+				wchar_t	wc;
 				int		clen = u8csize(c);
+				if ( c > 0xff || (c < ' ' && c != '\t') )
+					break;
 				if ( clen > 1 ) {
 					char mbs[7];
 					mbs[0] = c;
@@ -117,32 +194,35 @@ int nc_listbox(const char *title, const char **items, int defidx) {
 					}
 				else
 					wc = (wchar_t) c;
-				wi = u8towc(items[pos]);
-				if ( towupper(wi) >= towupper(wc) ) { // find next
-					for ( i = pos + 1; i < lines; i ++ ) {
-						wi = u8towc(items[i]);
-						if ( towupper(wi) == towupper(wc) ) {
-							pos = i;
-							found = true;
-							break;
-							}
+				wc = towupper(wc);
+
+				// repeating the same character cycles through the items that begins with it
+				if ( tlen == 1 && typed[0] == wc )
+					found = lb_typeahead(items, index, lines, pos, typed, 1, false);
+				else {
+					found = -1;
+					if ( tlen < TYPEAHEAD_MAX ) { // narrow
+						typed[tlen] = wc;
+						found = lb_typeahead(items, index, lines, pos, typed, tlen + 1, true);
+						if ( found >= 0 )
+							tlen ++;
 						}
-					}
-				if ( !found ) { // search from the beginning
-					for ( i = 0; i < lines; i ++ ) {
-						wi = u8towc(items[i]);
-						if ( towupper(wi) == towupper(wc) ) {
-							pos = i;
-							found = true;
-							break;
-							}
+					if ( found < 0 ) { // start a new search
+						typed[0] = wc;
+						tlen = 1;
+						found = lb_typeahead(items, index, lines, pos, typed, 1, false);
 						}
 					}
+				if ( found >= 0 )
+					pos = found;
+				continue;
 				}
 			}
+		tlen = 0; // any other key resets the type-ahead
 		} while ( !exf );
 
 	// cleanup
+	m_free(index);
 	delwin(w);
 	delwin(wout);
 	refresh();
@@ -56,9 +56,13 @@ void nc_init ();
 void nc_close();
 
 // keyboard
+typedef struct nc_keymap_s nc_keymap_t;
+nc_keymap_t *nc_keymap(const char *map_name);
+int  nc_mapprg(nc_keymap_t *map, int key);
 void nc_use_default_keymap();
 void nc_addkey(const char *map_name, int pkey, int key);
 void nc_delkey(const char *map_name, int key);
+void nc_clearkeys();
 void nc_setkey(const char *map_name, int pkey, ...);
 int  nc_getprg(const char *map_name, int key);
 int  nc_getkeycode(const char *key_name);
@@ -84,6 +88,26 @@ void nc_mvwprintf(WINDOW *win, int y, int x, const char *fmt, ...);
 #define nc_wprintf(w,f,...)	nc_mvwprintf(w,-1,-1,f,__VA_ARGS__)
 #define nc_printf(f,...)	nc_mvwprintf(stdscr,-1,-1,f,__VA_ARGS__)
 
+// compiled "escape-codes" format; list of spans, literal runs, attributes and argument slots
+enum { NC_SPAN_TEXT, NC_SPAN_ATTRON, NC_SPAN_ATTROFF, NC_SPAN_COLOR, NC_SPAN_PUSH, NC_SPAN_POP, NC_SPAN_ARG };
+enum { NC_ARG_INT, NC_ARG_LONG, NC_ARG_LLONG, NC_ARG_DOUBLE, NC_ARG_STR, NC_ARG_PTR };
+typedef struct {
+	int		op;			// NC_SPAN_xxx
+	int		val;		// attribute, VGA color or NC_ARG_xxx
+	int		ofs, len;	// literal text or conversion specification in the text buffer
+	} nc_span_t;
+typedef struct {
+	nc_span_t	*span;
+	int			count, alloc;
+	char		*text;
+	int			tlen, talloc;
+	} nc_fmt_t;
+
+nc_fmt_t *nc_compile(const char *fmt);
+nc_fmt_t *nc_fmt_free(nc_fmt_t *f);
+void nc_mvwputf(WINDOW *win, int y, int x, const nc_fmt_t *f, ...);
+#define nc_wputf(w,f,...)	nc_mvwputf(w,-1,-1,f,##__VA_ARGS__)
+
 // input string 
 // *editstr functions = edit contents of str; str must be a null terminated string
 // *readstr functions = the typical gets, str does not need to initialized
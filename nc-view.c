@@ -23,10 +23,10 @@
 
 //
 void nc_view(const char *title, const char *body) {
-	int		x, y, dx, dy, c, exf = 0, i, lines, wlines, offset;
-	char	**text = text_to_lines(body);
+	int		x, y, dx, dy, c, exf = 0, i, lines, wlines, rows, offset;
+	textspan_t *text = text_to_spans(body);
 	
-	for ( lines = 0; text[lines]; lines ++ ); // count lines in the text
+	lines = text->count;
 	
 	// outer window
 	x = 10; y = 5;
@@ -41,14 +41,15 @@ void nc_view(const char *title, const char *body) {
 	WINDOW	*w = subwin(wout, dy - 4, dx - 6, y + 2, x + 3);
 	keypad(w, TRUE);
 	wlines = dy - 4;
+	rows = getmaxy(w);
 	wrefresh(wout);
 
 	offset = 0;
 	do {
 		// EOT
-		bool eot = (lines - offset <= getmaxy(w));
+		bool eot = (lines - offset <= rows);
 		if ( eot ) {
-			offset = lines - getmaxy(w);
+			offset = lines - rows;
 			if ( offset < 0 ) offset = 0;
 			// ␄
 			nc_mvwprintf(wout, getmaxy(wout) - 2, getmaxx(wout) - 3, "$C20 $c");
@@ -59,8 +60,8 @@ void nc_view(const char *title, const char *body) {
 
 		//
 		werase(w);
-		for ( i = offset, y = 0; i < lines; i ++, y ++ )
-			mvwprintw(w, y, 0, "%s", text[i]);
+		for ( i = offset, y = 0; i < lines && y < rows; i ++, y ++ )
+			mvwaddnstr(w, y, 0, text->line[i].ptr, text->line[i].len);
 		wrefresh(w);
 		
 		c = wgetch(w);
@@ -96,7 +97,7 @@ void nc_view(const char *title, const char *body) {
 	delwin(w);
 	delwin(wout);
 	refresh();
-	free(text);
+	free_text_spans(text);
 	}
 
 
@@ -30,11 +30,18 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+#include <poll.h>
 #include <dirent.h>
 #include <wordexp.h>
 #include <ncurses.h>
@@ -45,6 +52,11 @@
 
 #include "list.h"
 #include "str.h"
+#include "fio.h"
+#include "bstore.h"
+#include "spawn.h"
+#include "trie.h"
+#include "trace.h"
 #include "nc-plus.h"
 #if defined(__GNU_GLIBC__)
 	#define FNM_GLIBC_EXTRA FNM_EXTMATCH
@@ -66,9 +78,19 @@
 #define OPT_STDIN	0x0800
 #define OPT_PRINT	0x1000
 #define OPT_NOCLOB	0x2000
+#define OPT_RESTORE	0x4000
+#define OPT_DAEMON	0x8000
+#define OPT_BATCH	0x10000
+
+#define APP_DESCR \
+"notes - notes manager"
+
+#define APP_VER "1.6"
 
 int		opt_flags = OPT_AUTO;
 int		opt_pv_filestat = 1;
+int		opt_hookwait = 0;		// run onstart/onexit in foreground
+int		opt_backups = 10;	// number of versions to keep in backup store, 0 = all
 
 int clr_normal = 0x07;
 int clr_select = 0x70;
@@ -87,13 +109,63 @@ static char bdir[PATH_MAX];	// backup directory
 static char conf[PATH_MAX];	// app configuration file
 static bool g_globber = true;
 static char sclob[64];
+static char sfsync[64];
 static char current_section[NAME_MAX];
 static char current_filter[NAME_MAX];
 static char default_ftype[NAME_MAX];
 static char onstart_cmd[LINE_MAX];
 static char onexit_cmd[LINE_MAX];
+static sp_cmd_t *onstart_sp, *onexit_sp;
 static list_t *exclude;
 
+// === configuration cache ==================================================
+// while notesrc is parsed, its effects are recorded in order; a record is
+// its type followed by NUL-terminated fields. the records are saved in the
+// cache directory and replayed on the next start, while notesrc is unchanged
+// and it is the same build; the records have indexes of its tables.
+
+#define CC_MAGIC	"NOTESRC1"	// change it with the records
+#define CC_BUILD	APP_VER " " __DATE__ " " __TIME__
+static char		*cc_buf;		// recording, or NULL
+static size_t	cc_len, cc_size;
+
+// append a record of 'type' with 'count' fields
+void cc_put(int type, int count, ...) {
+	va_list	ap;
+	const char *field;
+	size_t	len;
+
+	if ( !cc_buf )
+		return;
+	va_start(ap, count);
+	for ( int i = -1; i < count; i ++ ) {
+		field = ( i < 0 ) ? "" : va_arg(ap, const char *);
+		len = ( i < 0 ) ? 1 : strlen(field) + 1;
+		if ( cc_len + len > cc_size ) {
+			cc_size = (cc_len + len) * 2;
+			cc_buf = (char *) m_realloc(cc_buf, cc_size);
+			}
+		if ( i < 0 )
+			cc_buf[cc_len] = type;
+		else
+			memcpy(cc_buf + cc_len, field, len);
+		cc_len += len;
+		}
+	va_end(ap);
+	}
+
+// print a diagnostic of notesrc; it is recorded to be printed on replay too
+void rc_error(const char *fmt, ...) {
+	char	buf[LINE_MAX];
+	va_list	ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, LINE_MAX, fmt, ap);
+	va_end(ap);
+	fputs(buf, stderr);
+	cc_put('e', 1, buf);
+	}
+
 // returns true if the string 'str' is value of true
 bool istrue(const char *str) {
 	const char *p = str;
@@ -112,28 +184,37 @@ void excl_add_pat(const char *pars) {
 	char *ptr = strtok(string, delim);
 	while ( ptr ) {
 		list_addstr(exclude, ptr);
+		cc_put('x', 1, ptr);
 		ptr = strtok(NULL, delim);
 		}
 	m_free(string);
 	}
 
 // user menu
-typedef struct { char label[256]; char cmd[LINE_MAX]; } umenu_item_t;
+typedef struct { char label[256]; char cmd[LINE_MAX]; sp_cmd_t *sp; } umenu_item_t;
 static list_t *umenu;
 
-void umenu_add(const char *pars) {
-	char	*src = strdup(pars), *p;
+// add an item to the user menu
+void umenu_new(const char *label, const char *cmd) {
 	umenu_item_t u;
+
+	strcpy(u.label, label);
+	strcpy(u.cmd, cmd);
+	u.sp = sp_parse(u.cmd);
+	list_add(umenu, &u, sizeof(umenu_item_t));
+	cc_put('u', 2, label, cmd);
+	}
+
+void umenu_add(const char *pars) {
+	char	*src = strdup(pars), *p, *label;
 	
 	if ( (p = strchr(src, ';')) != NULL ) {
 		*p ++ = '\0';
 		while ( isblank(*p) )	p ++;
-		strcpy(u.cmd, p);
-		p = src;
-		while ( isblank(*p) )	p ++;
-		rtrim(p);
-		strcpy(u.label, p);
-		list_add(umenu, &u, sizeof(umenu_item_t));
+		label = src;
+		while ( isblank(*label) )	label ++;
+		rtrim(label);
+		umenu_new(label, p);
 		}
 	m_free(src);
 	}
@@ -176,6 +257,7 @@ static keyfunc_t keyfunc[] = {
 { "umenu",		KEY_PRG('m') },
 { "user-menu",		KEY_PRG('m') },
 { "search",		KEY_PRG(KEY_FIND) },
+{ "latency",	KEY_PRG('L') },
 { NULL, 0 } };
 
 // setup default keymap
@@ -212,6 +294,20 @@ void set_default_keymap() {
 	nc_setkey("nav", '!', KEY_F(10), 0);	// execute
 //	nc_setkey("nav", 'f', 0);	// set filter test
 	nc_setkey("nav", 'f', 0);	// file manager
+	nc_setkey("nav", 'L', KEY_F(12), 0);	// frame latency
+	}
+
+// assign the key to the function 'id' of the keymap, or remove it if 'id' < 0
+void keymap_set(const char *kmap, int id, int key) {
+	char	sid[16], skey[16];
+
+	if ( id < 0 )
+		nc_delkey(kmap, key);
+	else
+		nc_addkey(kmap, id, key);
+	snprintf(sid, sizeof(sid), "%d", id);
+	snprintf(skey, sizeof(skey), "%d", key);
+	cc_put('k', 3, kmap, sid, skey);
 	}
 
 // map key to command
@@ -293,13 +389,13 @@ void keymap_add(const char *pars) {
 
 		// if wc == 2 delete nodes of the keycode
 		if ( wc == 2 )
-			nc_delkey(kmap, key);
+			keymap_set(kmap, -1, key);
 
 		// if wc == 3 assign keycode to keycmd
 		if ( wc == 3 ) {
 			for ( int i = 0; keyfunc[i].keyword; i ++ ) {
 				if ( strcasecmp(keyfunc[i].keyword, keycmd) == 0 ) {
-					nc_addkey(kmap, keyfunc[i].id, key);
+					keymap_set(kmap, keyfunc[i].id, key);
 					break;
 					}
 				}
@@ -356,30 +452,40 @@ int getnum(const char *src) {
 	return n;
 	}
 
+// color table
+static struct { const char *key; int *intptr; } color_table[] = {
+	{ "normal", &clr_normal },
+	{ "text",   &clr_text },
+	{ "status", &clr_status },
+	{ "select", &clr_select },
+	{ "key",    &clr_status_key },
+	{ "code",   &clr_code },
+	{ "bold",   &clr_bold },
+	{ "hide",   &clr_hide },
+	{ NULL,     NULL } };
+
+// set the color 'i' of the table
+void color_assign(int i, int value) {
+	char	sval[16];
+
+	*(color_table[i].intptr) = value;
+	snprintf(sval, sizeof(sval), "%d", value);
+	cc_put('c', 2, color_table[i].key, sval);
+	}
+
 // color normal
 void color_setp(const char *pars) {
 	const char *p = pars;
-	static struct { const char *key; int *intptr; } ct[] = {
-		{ "normal", &clr_normal },
-		{ "text",   &clr_text },
-		{ "status", &clr_status },
-		{ "select", &clr_select },
-		{ "key",    &clr_status_key },
-		{ "code",   &clr_code },
-		{ "bold",   &clr_bold },
-		{ "hide",   &clr_hide },
-		{ NULL,     NULL } };
 
 	while ( isblank(*p) ) p ++;
-	for ( int i = 0; ct[i].key; i ++ ) {
-		if ( strncmp(p, ct[i].key, strlen(ct[i].key)) == 0 ) {
-			*(ct[i].intptr) = getnum(p + strlen(ct[i].key));
+	for ( int i = 0; color_table[i].key; i ++ ) {
+		if ( strncmp(p, color_table[i].key, strlen(color_table[i].key)) == 0 ) {
+			color_assign(i, getnum(p + strlen(color_table[i].key)));
 			break;
 			}
 		}
 	}
 
-// === configuration & interpreter ==========================================
 // === rules ================================================================
 
 // rule view *.[0-9] man %f
@@ -388,9 +494,91 @@ void color_setp(const char *pars) {
 // rule view *.txt   less %f
 // rule view *.pdf   okular %f
 // rule edit *       $EDITOR %f
-typedef struct { int code; char pattern[PATH_MAX], command[LINE_MAX]; } rule_t;
+typedef struct { int code, order; char pattern[PATH_MAX], command[LINE_MAX]; sp_cmd_t *cmd; } rule_t;
 static list_t *rules;
 
+// dispatch index; the '*.ext' rules are hashed by action and extension,
+// the '*' rules are the default of the action and the rest are checked
+// in order, only up to the rule found in the hash.
+typedef struct { int code; const char *ext; rule_t *rule; } rule_slot_t;
+static rule_slot_t *rule_hash;
+static int		rule_hsize, rule_hcount;
+static rule_t	*rule_any['z' + 1];	// the first '*' rule per action
+static list_t	*rule_other;		// other patterns, in order
+
+// hash of action and extension
+static unsigned rule_hkey(int code, const char *ext) {
+	unsigned h = 2166136261u ^ (unsigned) code;
+	for ( ; *ext; ext ++ )
+		h = (h ^ (unsigned char) *ext) * 16777619u;
+	return h;
+	}
+
+// returns the slot of action and extension in the hash
+static rule_slot_t *rule_slot(int code, const char *ext) {
+	unsigned i = rule_hkey(code, ext) & (rule_hsize - 1);
+	while ( rule_hash[i].rule && (rule_hash[i].code != code || strcmp(rule_hash[i].ext, ext) != 0) )
+		i = (i + 1) & (rule_hsize - 1);
+	return &rule_hash[i];
+	}
+
+// add the rule to the index; the first rule of each key wins
+void rule_index(rule_t *rule) {
+	const char *ext = rule->pattern + 2;
+	rule_slot_t *slot, *old;
+	int		oldsize;
+
+	if ( strcmp(rule->pattern, "*") == 0 ) {
+		if ( !rule_any[rule->code] )
+			rule_any[rule->code] = rule;
+		return;
+		}
+	if ( strncmp(rule->pattern, "*.", 2) != 0 || *ext == '\0' || strpbrk(ext, "*?[]\\./()|+@!") ) {
+		list_addptr(rule_other, rule);
+		return;
+		}
+	if ( (rule_hcount + 1) * 2 > rule_hsize ) { // grow
+		old = rule_hash;
+		oldsize = rule_hsize;
+		rule_hsize = ( rule_hsize ) ? rule_hsize * 2 : 32;
+		rule_hash = (rule_slot_t *) m_alloc(sizeof(rule_slot_t) * rule_hsize);
+		memset(rule_hash, 0, sizeof(rule_slot_t) * rule_hsize);
+		for ( int i = 0; i < oldsize; i ++ )
+			if ( old[i].rule ) *rule_slot(old[i].code, old[i].ext) = old[i];
+		if ( old ) m_free(old);
+		}
+	if ( (slot = rule_slot(rule->code, ext))->rule == NULL ) {
+		slot->code = rule->code;
+		slot->ext = ext;
+		slot->rule = rule;
+		rule_hcount ++;
+		}
+	}
+
+// free the index
+void rule_index_free() {
+	if ( rule_hash ) m_free(rule_hash);
+	rule_hash = NULL;
+	rule_hsize = rule_hcount = 0;
+	memset(rule_any, 0, sizeof(rule_any));
+	rule_other = list_destroy(rule_other);
+	}
+
+// append a new rule
+void rule_new(int action, const char *pattern, const char *command) {
+	rule_t	*rule = (rule_t *) m_alloc(sizeof(rule_t));
+	char	scode[2] = { (char) action, '\0' };
+
+	rule->code = action;
+	strcpy(rule->pattern, pattern);
+	strcpy(rule->command, command);
+	rule->cmd = sp_parse(command);
+	rule->order = list_count(rules);
+	rule_index((rule_t *) list_add(rules, rule, sizeof(rule_t))->data);
+	m_free(rule);
+	cc_put('r', 3, scode, pattern, command);
+	}
+
 // add rule to list
 void rule_add(const char *pars) {
 	char	*destp, pattern[PATH_MAX];
@@ -411,77 +599,192 @@ void rule_add(const char *pars) {
 			*destp = '\0';
 			if ( *p ) {
 				while ( isblank(*p) ) p ++;
-				if ( *p ) {
-					rule_t	*rule = (rule_t *) m_alloc(sizeof(rule_t));
-					rule->code = action;
-					strcpy(rule->pattern, pattern);
-					strcpy(rule->command, p);
-					list_add(rules, rule, sizeof(rule_t));
-					}
+				if ( *p )
+					rule_new(action, pattern, p);
 				}
 			}
 		}
 	}
 
-//
-int note_shell(const char *precmd, const char *files) {
-	const char *p = precmd, *s;
-	char dest[LINE_MAX], *d;
-	bool sq = false, dq = false;
-	
+// execute the command with the files (relative to ndir) and wait;
+// long lists are executed in chunks that fit in ARG_MAX
+int note_shell(const sp_cmd_t *cmd, const char **files, int count) {
+	char	*qf;
+	int		rv = 0, n, tr = tr_begin("note_shell");
+
 	setenv("NOTESDIR", ndir, 1);
-	setenv("NOTESFILES", files, 1);
-	d = dest;
-	while ( *p ) {
-		if ( *p == '\'' )
-			sq = !sq;
-		else if ( !sq ) {
-			if ( *p == '\"' )
-				dq = !dq;
-			else {
-				if ( *p == '%' ) {
-					switch ( *(p+1) ) {
-					case '%': // %%
-						*d ++ = '%';
-						p += 2;
-						continue;
-					case 'f': // files
-						for ( s = files; *s; *d ++ = *s ++ );
-						p += 2;
-						continue;
-						}
-					}
+	do {
+		n = ( count ) ? sp_chunk(cmd, files, count, "NOTESFILES") : 0;
+		qf = sp_quote(files, n);
+		setenv("NOTESFILES", qf, 1);
+		m_free(qf);
+		rv = sp_run(cmd, files, n);
+		files += n;
+		count -= n;
+		} while ( count > 0 );
+	tr_end(tr);
+	return rv;
+	}
+
+// returns the first rule of 'action' that matches the file
+rule_t *rule_find(int action, const char *fn) {
+	const char *base = ( (base = strrchr(fn, '/')) != NULL ) ? base + 1 : fn;
+	const char *ext;
+	rule_t	*found = NULL, *rule;
+
+	if ( *base != '.' ) { // FNM_PERIOD, the '*' does not match the leading period
+		if ( rule_hsize && (ext = strrchr(base, '.')) != NULL )
+			found = rule_slot(action, ext + 1)->rule;
+		if ( action <= 'z' && (rule = rule_any[action]) != NULL && (!found || rule->order < found->order) )
+			found = rule;
+		}
+	for ( list_node_t *cur = rule_other->head; cur; cur = cur->next ) {
+		rule = (rule_t *) cur->data;
+		if ( found && rule->order > found->order )
+			break;
+		if ( rule->code != action )
+			continue;
+		tr_count(TR_FNMATCH, 1);
+		if ( fnmatch(rule->pattern, base, FNM_PATHNAME | FNM_PERIOD | FNM_GLIBC_EXTRA) == 0 )
+			return rule;
+		}
+	return found;
+	}
+
+// execute the rules for the files; the files of each rule are passed
+// to one execution of its command. returns the number of files executed.
+int rule_exec_list(int action, const char **fns, int count) {
+	rule_t	**frule = (rule_t **) m_alloc(sizeof(rule_t *) * (count + 1));
+	const char **group = (const char **) m_alloc(sizeof(char *) * (count + 1));
+	size_t	root_dir_len = strlen(ndir) + 1;
+	int		i, j, n, done = 0;
+
+	for ( i = 0; i < count; i ++ )
+		frule[i] = rule_find(action, fns[i]);
+	for ( i = 0; i < count; i ++ ) {
+		if ( frule[i] == NULL )
+			continue;
+		rule_t *rule = frule[i];
+		for ( j = i, n = 0; j < count; j ++ ) { // the group, in order
+			if ( frule[j] == rule ) {
+				group[n ++] = ( fns[j][0] == '/' ) ? fns[j] + root_dir_len : fns[j];
+				frule[j] = NULL;
 				}
 			}
-		*d ++ = *p ++;
+		note_shell(rule->cmd, group, n);
+		done += n;
 		}
-	*d = '\0';
-	return system(dest);
+	m_free(group);
+	m_free(frule);
+	return done;
 	}
 
 // execute rule for the file 'fn'
 bool rule_exec(int action, const char *fn) {
-	const char *base;
-	size_t root_dir_len = strlen(ndir) + 1;
+	return (rule_exec_list(action, &fn, 1) == 1);
+	}
+
+// === hooks ================================================================
+// onstart runs while the explorer scans and works, onexit runs detached;
+// the hooks of all instances are serialized by a lock file.
 
-	list_node_t	*cur = rules->head;
-	if ( (base = strrchr(fn, '/')) == NULL )
+typedef struct {
+	pid_t	pid;			// running process or 0
+	int		out;			// its output (unlinked temporary file) or -1
+	off_t	ofs;			// bytes of output read
+	time_t	start;
+	char	line[256];		// last line of output
+	} hook_t;
+
+// acquire the lock of the hooks (blocks); returns the descriptor that holds it
+int hook_lock() {
+	char	path[PATH_MAX];
+	int		fd;
+
+	if ( getenv("XDG_RUNTIME_DIR") )
+		snprintf(path, PATH_MAX, "%s/notes-hooks.lock", getenv("XDG_RUNTIME_DIR"));
+	else
+		snprintf(path, PATH_MAX, "/tmp/notes-hooks-%d.lock", (int) getuid());
+	if ( (fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) >= 0 ) {
+		while ( flock(fd, LOCK_EX) != 0 && errno == EINTR );
+		}
+	return fd;
+	}
+
+// execute the hook in foreground, holding the lock
+int hook_run(const sp_cmd_t *cmd) {
+	int		lk = hook_lock(), rv;
+	rv = note_shell(cmd, NULL, 0);
+	if ( lk >= 0 ) close(lk);
+	return rv;
+	}
+
+// start the hook in background; its output goes to 'hook->out', or nowhere
+// if 'detach'. a file and not a pipe, the hook may outlive the explorer.
+// returns false if it cannot start.
+bool hook_start(hook_t *hook, const sp_cmd_t *cmd, bool detach) {
+	char	tmp[] = "/tmp/notes-hook-XXXXXX";
+	int		nul, st;
+
+	memset(hook, 0, sizeof(hook_t));
+	hook->out = -1;
+	if ( !detach ) {
+		if ( (hook->out = mkostemp(tmp, O_CLOEXEC)) < 0 )
+			return false;
+		unlink(tmp);
+		}
+	if ( (hook->pid = fork()) < 0 ) {
+		if ( hook->out >= 0 ) close(hook->out);
+		hook->out = -1;
+		hook->pid = 0;
 		return false;
-	base ++;
-	while ( cur ) {
-		rule_t *rule = (rule_t *) cur->data;
-		if ( rule->code == action && fnmatch(rule->pattern, base, FNM_PATHNAME | FNM_PERIOD | FNM_GLIBC_EXTRA) == 0 ) {
-			char file[PATH_MAX];
-			if ( fn[0] == '/' )
-				snprintf(file, PATH_MAX, "'%s'", fn + root_dir_len);
-			else
-				snprintf(file, PATH_MAX, "'%s'", fn);
-			note_shell(rule->command, file);
-			return true;
-			}
-		cur = cur->next;
 		}
-	return false;
+	if ( hook->pid == 0 ) { // child
+		if ( detach )
+			setsid();
+		if ( (nul = open("/dev/null", O_RDWR)) >= 0 )
+			dup2(nul, STDIN_FILENO);
+		dup2((detach) ? nul : hook->out, STDOUT_FILENO);
+		dup2((detach) ? nul : hook->out, STDERR_FILENO);
+		st = hook_run(cmd);
+		_exit(( WIFEXITED(st) ) ? WEXITSTATUS(st) : 127);
+		}
+	tr_count(TR_SPAWN, 1);
+	hook->start = time(NULL);
+	return true;
+	}
+
+// read the new output; keeps the last line
+void hook_read(hook_t *hook) {
+	char	buf[1024], *p, *e;
+	ssize_t	n;
+
+	while ( hook->out >= 0 && (n = pread(hook->out, buf, sizeof(buf) - 1, hook->ofs)) > 0 ) {
+		hook->ofs += n;
+		buf[n] = '\0';
+		while ( n && (buf[n - 1] == '\n' || buf[n - 1] == '\r') )
+			buf[-- n] = '\0';
+		if ( n == 0 )
+			continue;
+		for ( p = buf; (e = strpbrk(p, "\r\n")) != NULL && e[1]; p = e + 1 ); // last line
+		snprintf(hook->line, sizeof(hook->line), "%s", p);
+		}
+	}
+
+// returns true if the hook is completed; its exit code to 'status'
+bool hook_done(hook_t *hook, int *status) {
+	int		st;
+
+	hook_read(hook);
+	if ( hook->pid == 0 || waitpid(hook->pid, &st, WNOHANG) != hook->pid )
+		return false;
+	hook_read(hook);
+	if ( hook->out >= 0 )
+		close(hook->out);
+	hook->out = -1;
+	hook->pid = 0;
+	*status = ( WIFEXITED(st) ) ? WEXITSTATUS(st) : -1;
+	return true;
 	}
 
 // === configuration & interpreter ==========================================
@@ -492,10 +795,13 @@ var_t var_table[] = {
 	{ "notebook", 's', ndir },
 	{ "backupdir", 's', bdir },
 	{ "clobber", 's', sclob },
+	{ "fsync", 's', sfsync },
 	{ "deftype", 's', default_ftype },
 	{ "onstart", 's', onstart_cmd },
 	{ "onexit", 's', onexit_cmd },
 	{ "pvhead", 'b', &opt_pv_filestat },
+	{ "hookwait", 'b', &opt_hookwait },
+	{ "backups", 'i', &opt_backups },
 	{ NULL, '\0', NULL } };
 
 // table of commands
@@ -516,6 +822,7 @@ void command_set(int line, const char *variable, const char *value) {
 			switch ( var_table[i].type ) {
 			case 's':
 				strcpy((char *)(var_table[i].value), value);
+				cc_put('s', 2, variable, value);
 				break;
 			case 'i':
 			case 'b':
@@ -529,15 +836,17 @@ void command_set(int line, const char *variable, const char *value) {
 					else n = atoi(value);
 					}
 				*((int *)(var_table[i].value)) = n;
+				cc_put('s', 2, variable, value);
 				break;
 			case 'f':
 				*((double *)(var_table[i].value)) = atof(value);
+				cc_put('s', 2, variable, value);
 				break;
 				}
 			return;
 			}
 		}
-	fprintf(stderr, "rc(%d): uknown variable [%s]\n", line, variable);
+	rc_error("rc(%d): uknown variable [%s]\n", line, variable);
 	}
 
 // execute commands
@@ -549,7 +858,7 @@ void command_exec(int line, const char *command, const char *parameters) {
 			return;
 			}
 		}
-	fprintf(stderr, "rc(%d): uknown command [%s]\n", line, command);
+	rc_error("rc(%d): uknown command [%s]\n", line, command);
 	}
 
 // parse string line
@@ -572,22 +881,160 @@ void parse(int line, const char *source) {
 		}
 	}
 
-// read configuration file
+// the cache file header; the source is valid if it is the same file, unmodified
+typedef struct {
+	char	magic[8];
+	char	build[32];	// CC_BUILD
+	dev_t	dev;
+	ino_t	ino;
+	struct timespec mtime;
+	off_t	size;
+	size_t	rclen, len;		// the length of the source name and of the records
+	} cc_head_t;
+
+// the cache file of the configuration 'rc'
+void cc_path(const char *rc, char *path) {
+	unsigned h = 2166136261u;
+	for ( const char *p = rc; *p; p ++ )
+		h = (h ^ (unsigned char) *p) * 16777619u;
+	if ( getenv("XDG_CACHE_HOME") )
+		snprintf(path, PATH_MAX, "%s/notes/notesrc-%08x", getenv("XDG_CACHE_HOME"), h);
+	else
+		snprintf(path, PATH_MAX, "%s/.cache/notes/notesrc-%08x", home, h);
+	}
+
+// check the records of the cache and execute them if 'apply'
+bool cc_replay(const char *p, const char *end, bool apply) {
+	const char *f[3];
+	int		type, count, i;
+
+	while ( p < end ) {
+		type = *p ++;
+		switch ( type ) {
+		case 'x': case 'e': count = 1; break;
+		case 's': case 'u': case 'c': count = 2; break;
+		case 'r': case 'k': count = 3; break;
+		default: return false; }
+		for ( i = 0; i < count; i ++ ) {
+			const char *e = memchr(p, '\0', end - p);
+			if ( !e ) return false;
+			f[i] = p;
+			p = e + 1;
+			}
+		if ( !apply )
+			continue;
+		switch ( type ) {
+		case 'x': list_addstr(exclude, f[0]); break;
+		case 'e': fputs(f[0], stderr); break;
+		case 's': command_set(0, f[0], f[1]); break;
+		case 'u': umenu_new(f[0], f[1]); break;
+		case 'r': rule_new(*f[0], f[1], f[2]); break;
+		case 'k': keymap_set(f[0], atoi(f[1]), atoi(f[2])); break;
+		case 'c':
+			for ( i = 0; color_table[i].key; i ++ )
+				if ( strcmp(color_table[i].key, f[0]) == 0 )
+					color_assign(i, atoi(f[1]));
+			break;
+			}
+		}
+	return true;
+	}
+
+// load the configuration from the cache; returns false if it is not valid
+bool cc_load(const char *rc, const struct stat *st) {
+	char	path[PATH_MAX], *buf;
+	cc_head_t *h;
+	struct stat cst;
+	bool	ok = false;
+	int		fd;
+
+	cc_path(rc, path);
+	if ( (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 )
+		return false;
+	if ( fstat(fd, &cst) == 0 && cst.st_size >= (off_t) sizeof(cc_head_t) ) {
+		buf = (char *) m_alloc(cst.st_size);
+		h = (cc_head_t *) buf;
+		tr_count(TR_READ, cst.st_size);
+		if ( read(fd, buf, cst.st_size) == cst.st_size
+				&& memcmp(h->magic, CC_MAGIC, sizeof(h->magic)) == 0
+				&& strncmp(h->build, CC_BUILD, sizeof(h->build)) == 0
+				&& h->dev == st->st_dev && h->ino == st->st_ino && h->size == st->st_size
+				&& h->mtime.tv_sec == st->st_mtim.tv_sec && h->mtime.tv_nsec == st->st_mtim.tv_nsec
+				&& sizeof(cc_head_t) + h->rclen + h->len == (size_t) cst.st_size
+				&& h->rclen == strlen(rc) && memcmp(buf + sizeof(cc_head_t), rc, h->rclen) == 0 ) {
+			const char *p = buf + sizeof(cc_head_t) + h->rclen;
+			if ( (ok = cc_replay(p, p + h->len, false)) )
+				cc_replay(p, p + h->len, true);
+			}
+		m_free(buf);
+		}
+	close(fd);
+	return ok;
+	}
+
+// save the recorded configuration to the cache; errors are ignored
+void cc_save(const char *rc, const struct stat *st) {
+	char	path[PATH_MAX], tmp[PATH_MAX], *p;
+	cc_head_t h;
+	int		fd;
+
+	cc_path(rc, path);
+	p = strrchr(path, '/');
+	*p = '\0';
+	fio_mkdirs(path, 0700);
+	snprintf(tmp, PATH_MAX, "%s/.notesrc-XXXXXX", path);
+	*p = '/';
+	if ( (fd = mkostemp(tmp, O_CLOEXEC)) < 0 )
+		return;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CC_MAGIC, sizeof(h.magic));
+	strncpy(h.build, CC_BUILD, sizeof(h.build));
+	h.dev = st->st_dev;
+	h.ino = st->st_ino;
+	h.mtime = st->st_mtim;
+	h.size = st->st_size;
+	h.rclen = strlen(rc);
+	h.len = cc_len;
+	if ( write(fd, &h, sizeof(h)) == sizeof(h) && write(fd, rc, h.rclen) == (ssize_t) h.rclen
+			&& write(fd, cc_buf, cc_len) == (ssize_t) cc_len && close(fd) == 0 ) {
+		if ( rename(tmp, path) == 0 )
+			return;
+		}
+	else
+		close(fd);
+	unlink(tmp);
+	}
+
+// read configuration file; the parsed configuration is cached
+static struct stat conf_st;	// the source, to detect changes
 void read_conf(const char *rc) {
-	int line = 0;
+	int line = 0, tr = tr_begin("read_conf");
 	
-	if ( access(rc, R_OK) == 0 ) {
+	memset(&conf_st, 0, sizeof(conf_st));
+	tr_count(TR_STAT, 1);
+	if ( access(rc, R_OK) == 0 && stat(rc, &conf_st) == 0 ) {
+		if ( cc_load(rc, &conf_st) ) {
+			tr_end(tr);
+			return;
+			}
 		char buf[LINE_MAX];
 		FILE *fp = fopen(rc, "r");
 		if ( fp ) {
+			cc_buf = (char *) m_alloc(cc_size = LINE_MAX);
+			cc_len = 0;
 			while ( fgets(buf, LINE_MAX, fp) ) {
 				line ++;
+				tr_count(TR_READ, strlen(buf));
 				rtrim(buf);
 				parse(line, buf);
 				}
 			fclose(fp);
+			cc_save(rc, &conf_st);
+			m_free(cc_buf);
+			cc_buf = NULL;
 			}
 		}
+	tr_end(tr);
 	}
 
 // === notes ================================================================
@@ -601,74 +1048,191 @@ typedef struct {
 	} note_t;
 list_t	*notes, *sections;
 
-// copy file
-bool copy_file(const char *src, const char *trg) {
-	FILE	*inp, *outp, *logf = stderr;
-	char	buf[LINE_MAX], *p;
-	size_t	bytes;
-	
-//	logf = fopen("/tmp/notes.log", "a");
-//	fprintf(logf, "copy_file(\"%s\", \"%s\")\n", src, trg);
-	
-	if ( (inp = fopen(src, "r")) == NULL ) {
-		fprintf(logf, "%s: errno %d: %s\n", src, errno, strerror(errno));
-		return false;
-		}
-	if ( (p = strrchr(trg, '/')) != NULL ) {
-		char *dd = strdup(trg);
-		dd[p - trg] = '\0';
-		if ( access(dd, W_OK) != 0 ) { // new section ?
-			if ( mkdir(dd, 0755) != 0 ) {
-				fprintf(logf, "%s: errno %d: %s (mkdir [%s])\n", trg, errno, strerror(errno), dd);
-				fclose(inp);
-				m_free(dd);
-				return false;
+// === directory descriptors ================================================
+// file operations are relative to the descriptors of the notebook and the
+// sections, so the kernel does not resolve the full path at each call.
+// the last used SECFD_MAX sections are kept open; they are flushed when
+// the notebook is scanned again, the directories may be removed or renamed.
+
+#define SECFD_MAX	32
+static int	ndir_fd = AT_FDCWD;
+typedef struct { char name[NAME_MAX]; int fd; } secfd_t;
+static list_t *secfds;
+
+// returns the descriptor of the directory of the section, or -1
+int section_fd(const char *section) {
+	list_node_t *cur;
+	secfd_t	sfd;
+	int		count = 0;
+
+	if ( *section == '\0' )
+		return ndir_fd;
+	for ( cur = secfds->head; cur; cur = cur->next, count ++ ) {
+		if ( strcmp(((secfd_t *) cur->data)->name, section) == 0 ) {
+			sfd = *((secfd_t *) cur->data);
+			if ( cur != secfds->tail ) { // the most recent is at the tail
+				list_delete(secfds, cur);
+				list_add(secfds, &sfd, sizeof(secfd_t));
 				}
+			return sfd.fd;
 			}
-		m_free(dd);
-		}
-	if ( (outp = fopen(trg, "w")) == NULL ) {
-		fprintf(logf, "%s: errno %d: %s\n", trg, errno, strerror(errno));
-		fclose(inp);
-		return false;
 		}
-	
-	// copy
-	while ( !feof(inp) ) {
-		if ( (bytes = f_read(buf, 1, sizeof(buf), inp)) > 0 )
-			f_write(buf, 1, bytes, outp);
+	if ( (sfd.fd = openat(ndir_fd, section, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )
+		return -1;
+	if ( count >= SECFD_MAX ) { // the least recent
+		close(((secfd_t *) secfds->head->data)->fd);
+		list_delete(secfds, secfds->head);
 		}
-	
-	// close
-	fclose(outp);
-	fclose(inp);
-	return true;
+	strcpy(sfd.name, section);
+	list_add(secfds, &sfd, sizeof(secfd_t));
+	return sfd.fd;
+	}
+
+// close the descriptors of the sections
+void section_fd_flush() {
+	for ( list_node_t *cur = secfds->head; cur; cur = cur->next )
+		close(((secfd_t *) cur->data)->fd);
+	list_clear(secfds);
+	}
+
+// close the cached descriptors
+void section_fd_close() {
+	section_fd_flush();
+	if ( ndir_fd >= 0 )
+		close(ndir_fd);
+	ndir_fd = AT_FDCWD;
+	}
+
+// filename of the note relative to its section directory
+const char *note_fname(const note_t *note) {
+	const char *p = strrchr(note->file, '/');
+	return ( p ) ? p + 1 : note->file;
+	}
+
+// open the note-file for reading
+FILE *note_fopen(const note_t *note) {
+	FILE	*fp;
+	int		fd;
+
+	if ( (fd = openat(section_fd(note->section), note_fname(note), O_RDONLY | O_CLOEXEC)) < 0 )
+		return NULL;
+	if ( (fp = fdopen(fd, "r")) == NULL )
+		close(fd);
+	return fp;
 	}
 
 // backup note-file
 bool note_backup(const note_t *note) {
-	char	bckf[PATH_MAX];
+	const char *fname = note_fname(note);
 
 	if ( strlen(bdir) ) {
-		if ( strlen(note->section) )
-			snprintf(bckf, PATH_MAX, "%s/%s/%s", bdir, note->section, note->name);
-		else
-			snprintf(bckf, PATH_MAX, "%s/%s", bdir, note->name);
-		return copy_file(note->file, bckf);
+		if ( !bs_store(bdir, note->section, fname, section_fd(note->section), fname, opt_backups) ) {
+			fprintf(stderr, "backup %s: errno %d: %s\n", note->file, errno, strerror(errno));
+			return false;
+			}
 		}
 	return true;
 	}
 
+// === output ===============================================================
+// buffered output of the listings, flushed with write(2)
+
+#define OUT_TEXT	0	// lines
+#define OUT_NULL	1	// NUL terminated records (-0)
+#define OUT_JSON	2	// JSON object per line (--json)
+static int		opt_out = OUT_TEXT;
+static char		ob_buf[0x10000];
+static size_t	ob_len;
+static int		ob_fd = STDOUT_FILENO;	// or the socket of the daemon
+
+// flush the output buffer
+void ob_flush() {
+	const char *p = ob_buf;
+	ssize_t n;
+	
+	fflush(stdout);
+	while ( ob_len ) {
+		if ( (n = write(ob_fd, p, ob_len)) < 0 ) {
+			if ( errno == EINTR )
+				continue;
+			break; // i.e. EPIPE
+			}
+		p += n;
+		ob_len -= n;
+		}
+	ob_len = 0;
+	}
+
+// append bytes to output buffer
+void ob_write(const char *src, size_t len) {
+	if ( ob_len + len > sizeof(ob_buf) )
+		ob_flush();
+	if ( len > sizeof(ob_buf) ) {
+		fflush(stdout);
+		write(ob_fd, src, len);
+		return;
+		}
+	memcpy(ob_buf + ob_len, src, len);
+	ob_len += len;
+	}
+
+void ob_puts(const char *str)	{ ob_write(str, strlen(str)); }
+void ob_putc(char c)			{ ob_write(&c, 1); }
+
+// writes a JSON string
+void ob_json_str(const char *str) {
+	const char *p, *s = str;
+	char	esc[8];
+	
+	ob_putc('"');
+	for ( p = str; *p; p ++ ) {
+		if ( *p == '"' || *p == '\\' || (unsigned char) *p < 0x20 ) {
+			ob_write(s, p - s);
+			s = p + 1;
+			switch ( *p ) {
+			case '"':	ob_puts("\\\""); break;
+			case '\\':	ob_puts("\\\\"); break;
+			case '\n':	ob_puts("\\n"); break;
+			case '\t':	ob_puts("\\t"); break;
+			default:
+				snprintf(esc, sizeof(esc), "\\u%04x", *p);
+				ob_puts(esc);
+				}
+			}
+		}
+	ob_write(s, p - s);
+	ob_putc('"');
+	}
+
+// returns the maximum width of the section names
+size_t sections_maxlen() {
+	size_t	seclen = 0;
+	for ( list_node_t *cur = sections->head; cur; cur = cur->next )
+		seclen = MAX(seclen, strlen((const char *) cur->data));
+	return seclen;
+	}
+
 // prints information about the note
-void note_pl(const note_t *note) {
+// 'seclen' is the width of the section column, it is not used with --files or --json
+void note_pl(const note_t *note, size_t seclen) {
+	char	buf[PATH_MAX + NAME_MAX * 3];
+	int		n;
+	
+	if ( opt_out == OUT_JSON ) {
+		ob_puts("{\"section\":");	ob_json_str(note->section);
+		ob_puts(",\"name\":");	ob_json_str(note->name);
+		ob_puts(",\"type\":");	ob_json_str(note->ftype);
+		ob_puts(",\"file\":");	ob_json_str(note->file);
+		ob_puts("}\n");
+		return;
+		}
 	if ( opt_flags & OPT_FILES )
-		printf("%s\n", note->file);
+		ob_puts(note->file);
 	else {
-		size_t	seclen = 0;
-		for ( list_node_t *cur = sections->head; cur; cur = cur->next )
-			seclen = MAX(seclen, strlen((const char *) cur->data));
-		printf("%-*s (%-3s) - %s\n", seclen, note->section, note->ftype, note->name);
+		n = snprintf(buf, sizeof(buf), "%-*s (%-3s) - %s", (int) seclen, note->section, note->ftype, note->name);
+		ob_write(buf, MIN(n, sizeof(buf) - 1));
 		}
+	ob_putc((opt_out == OUT_NULL) ? '\0' : '\n');
 	}
 
 // simple print (mode --print) of a note
@@ -677,19 +1241,68 @@ void note_print(const note_t *note) {
 	char buf[LINE_MAX];
 	
 	printf("=== %s ===\n", note->name);
-	if ( (fp = fopen(note->file, "rt")) != NULL ) {
-		while ( fgets(buf, LINE_MAX, fp) )
+	if ( (fp = note_fopen(note)) != NULL ) {
+		while ( fgets(buf, LINE_MAX, fp) ) {
+			tr_count(TR_READ, strlen(buf));
 			printf("%s", buf);
+			}
 		fclose(fp);
 		}
 	else
 		fprintf(stderr, "errno %d: %s\n", errno, strerror(errno));
 	}
 
+// deleted notes are moved here when the backupdir is on the same filesystem
+#define TRASH_DIR	".trash"
+
+// returns the trash path of the note, or false if the trash is on another filesystem
+bool note_trash_path(const note_t *note, char *path) {
+	static dev_t bdev;
+	static bool	 bdev_ok = false;
+	struct stat	st;
+	const char	*fname = note_fname(note);
+
+	if ( strlen(bdir) == 0 )
+		return false;
+	if ( !bdev_ok ) {
+		if ( stat(bdir, &st) != 0 )
+			return false;
+		bdev = st.st_dev;
+		bdev_ok = true;
+		}
+	if ( fstatat(section_fd(note->section), fname, &st, AT_SYMLINK_NOFOLLOW) != 0 || st.st_dev != bdev )
+		return false;
+	if ( strlen(note->section) )
+		snprintf(path, PATH_MAX, "%s/" TRASH_DIR "/%s/%s", bdir, note->section, fname);
+	else
+		snprintf(path, PATH_MAX, "%s/" TRASH_DIR "/%s", bdir, fname);
+	return true;
+	}
+
 // delete a note
 bool note_delete(const note_t *note) {
+	char	trash[PATH_MAX], *p;
+	int		sfd = section_fd(note->section);
+
+	if ( note_trash_path(note, trash) ) { // rename into the trash, no data i/o
+		p = strrchr(trash, '/');
+		*p = '\0';
+		bool ok = fio_mkdirs(trash, 0700);
+		*p = '/';
+		if ( ok ) {
+			if ( access(trash, F_OK) == 0 ) // a previously deleted note, keep it in versions
+				bs_store(bdir, note->section, p + 1, AT_FDCWD, trash, opt_backups);
+			if ( renameat(sfd, note_fname(note), AT_FDCWD, trash) == 0 )
+				return true;
+			if ( errno == EXDEV ) { // the trash is on another filesystem
+				unlink(trash);
+				if ( fio_copyat(sfd, note_fname(note), AT_FDCWD, trash) )
+					return (unlinkat(sfd, note_fname(note), 0) == 0);
+				}
+			}
+		}
 	note_backup(note);
-	return (remove(note->file) == 0);
+	return (unlinkat(sfd, note_fname(note), 0) == 0);
 	}
 
 // check filename to add in results list
@@ -698,74 +1311,184 @@ bool dirwalk_checkfn(const char *fn) {
 	
     if ( strcmp(fn, ".") == 0 || strcmp(fn, "..") == 0 )
 		return false;
+	if ( strncmp(fn, FIO_TMP_PREFIX, sizeof(FIO_TMP_PREFIX) - 1) == 0 ) // being written
+		return false;
 	for ( cur = exclude->head; cur; cur = cur->next ) {
+		tr_count(TR_FNMATCH, 1);
 		if ( fnmatch((const char *) cur->data, fn, FNM_PATHNAME | FNM_PERIOD | FNM_GLIBC_EXTRA | FNM_CASEFOLD) == 0 )
 			return false;
 		}
 	return true;
 	}
 
-// walk throu subdirs to collect notes
-void dirwalk(const char *name) {
+// if 'dirwalk_hook' is set, it is called for each note collected
+// if 'dirwalk_dirhook' is set, it is called for each directory with its descriptor
+static void (*dirwalk_hook)(note_t *note);
+static void (*dirwalk_dirhook)(const char *rel, int fd);
+
+// collect the file 'fname' of the directory 'fd'; 'path' is relative to ndir
+void dirwalk_note(int fd, const char *path, const char *fname) {
+	note_t *note = (note_t *) m_alloc(sizeof(note_t));
+	char	buf[PATH_MAX], *p, *e;
+	snprintf(note->file, PATH_MAX, "%s/%s", ndir, path);
+	strcpy(buf, path);
+	if ( (e = strrchr(buf, '.')) != NULL ) {
+		*e = '\0';
+		strcpy(note->ftype, e + 1);
+		}
+	if ( (p = strrchr(buf, '/')) != NULL ) {
+		*p = '\0';
+		strcpy(note->section, buf);
+		strcpy(note->name, p + 1);
+		}
+	else {
+		note->section[0] = '\0';
+		strcpy(note->name, buf);
+		}
+	if ( strlen(current_filter) )
+		tr_count(TR_FNMATCH, 1);
+	if ( strlen(current_filter) == 0 || fnmatch(current_filter, note->name, FNM_PATHNAME | FNM_PERIOD | FNM_GLIBC_EXTRA | FNM_CASEFOLD) == 0 ) {
+		tr_count(TR_STAT, 1);
+		fstatat(fd, fname, &note->st, 0);
+		list_node_t *node = list_add(notes, note, sizeof(note_t));
+		m_free(note);
+		note = (note_t *) node->data;
+		if ( list_findstr(sections, note->section) == NULL )
+			list_addstr(sections, note->section);
+		if ( dirwalk_hook )
+			dirwalk_hook(note);
+		}
+	else
+		m_free(note);
+	}
+
+// walk throu subdirs to collect notes; 'rel' is the directory relative to ndir,
+// only its files are collected if not 'deep'
+void dirwalk_at(const char *rel, bool deep) {
 	DIR *dir;
 	struct dirent *entry;
+	struct stat st;
     char path[PATH_MAX];
-	size_t root_dir_len = strlen(ndir) + 1;
+	int	fd;
 
-	if ( !(dir = opendir(name)) )	return;
+	if ( (fd = openat(ndir_fd, (*rel) ? rel : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )	return;
+	if ( !(dir = fdopendir(fd)) ) {
+		close(fd);
+		return;
+		}
+	if ( dirwalk_dirhook )
+		dirwalk_dirhook(rel, fd);
 	while ( (entry = readdir(dir)) != NULL ) {
+		tr_count(TR_FILES, 1);
 		if ( !dirwalk_checkfn(entry->d_name) )
 			continue;
-		snprintf(path, sizeof(path), "%s/%s", name, entry->d_name);
-		if ( entry->d_type == DT_DIR ) 
-			dirwalk(path);
-		else {
-			note_t *note = (note_t *) m_alloc(sizeof(note_t));
-			char	buf[PATH_MAX], *p, *e;
-			strcpy(note->file, path);
-			strcpy(buf, path + root_dir_len);
-			if ( (e = strrchr(buf, '.')) != NULL ) {
-				*e = '\0';
-				strcpy(note->ftype, e + 1);
-				}
-			if ( (p = strrchr(buf, '/')) != NULL ) {
-				*p = '\0';
-				strcpy(note->section, buf);
-				strcpy(note->name, p + 1);
-				}
-			else {
-				note->section[0] = '\0';
-				strcpy(note->name, buf);
-				}
-			if ( strlen(current_filter) == 0 || fnmatch(current_filter, note->name, FNM_PATHNAME | FNM_PERIOD | FNM_GLIBC_EXTRA | FNM_CASEFOLD) == 0 ) {
-				stat(note->file, &note->st);
-				list_add(notes, note, sizeof(note_t));
-				if ( list_findstr(sections, note->section) == NULL )
-					list_addstr(sections, note->section);
-				}
-			else
-				m_free(note);
+		if ( *rel )
+			snprintf(path, sizeof(path), "%s/%s", rel, entry->d_name);
+		else
+			snprintf(path, sizeof(path), "%s", entry->d_name);
+		if ( entry->d_type == DT_UNKNOWN ) {
+			tr_count(TR_STAT, 1);
+			if ( fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) )
+				entry->d_type = DT_DIR;
 			}
+		if ( entry->d_type == DT_DIR ) {
+			if ( deep )
+				dirwalk_at(path, true);
+			}
+		else
+			dirwalk_note(fd, path, entry->d_name);
 		}
 	closedir(dir);
 	}
 
-// copy contents of file to output
-bool print_file_to(const char *file, FILE *output) {
-	FILE	*input;
-	char	buf[LINE_MAX];
-	size_t	bytes;
+// walk throu 'rel' and its subdirs to collect notes
+void dirwalk(const char *rel) {
+	dirwalk_at(rel, true);
+	}
+
+// === note writer ========================================================
+// new contents are written to a temporary file in the section and renamed
+// over the note; appends use O_APPEND. readers never see a half-written note.
+
+#define FSYNC_NONE	0	// leave it to the kernel
+#define FSYNC_DATA	1	// fdatasync the note
+#define FSYNC_FULL	2	// fsync the note and its directory
+static int	opt_fsync = FSYNC_NONE;
+
+typedef struct {
+	int		fd;				// output
+	int		dfd;			// section directory
+	const char *fname;		// note-file relative to dfd
+	char	tmp[NAME_MAX];	// temporary file, empty on append
+	} nwriter_t;
+
+// open the note for writing; 'append' or replace the contents
+bool nw_open(nwriter_t *w, const note_t *note, bool append) {
+	w->dfd = section_fd(note->section);
+	w->fname = note_fname(note);
+	w->tmp[0] = '\0';
+	if ( append )
+		w->fd = openat(w->dfd, w->fname, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+	else {
+		snprintf(w->tmp, NAME_MAX, FIO_TMP_PREFIX "XXXXXX");
+		w->fd = fio_mkstempat(w->dfd, w->tmp);
+		}
+	return (w->fd >= 0);
+	}
+
+// complete the note; if not 'commit' the new contents are discarded
+bool nw_close(nwriter_t *w, bool commit) {
+	struct stat st;
+	mode_t	mask;
+	bool	rv = commit;
+	int		e = errno; // the error of the caller if not 'commit'
+
+	if ( rv && opt_fsync != FSYNC_NONE ) {
+		if ( ((opt_fsync == FSYNC_DATA) ? fdatasync(w->fd) : fsync(w->fd)) != 0 ) {
+			e = errno;
+			rv = false;
+			}
+		}
+	if ( rv && w->tmp[0] ) { // mkstemp creates 0600, use the mode of the note or the umask
+		if ( fstatat(w->dfd, w->fname, &st, 0) == 0 )
+			fchmod(w->fd, st.st_mode & 07777);
+		else {
+			mask = umask(0);
+			umask(mask);
+			fchmod(w->fd, 0666 & ~mask);
+			}
+		}
+	if ( close(w->fd) != 0 && rv ) { e = errno; rv = false; }
+	if ( w->tmp[0] ) {
+		if ( rv && renameat(w->dfd, w->tmp, w->dfd, w->fname) != 0 ) { e = errno; rv = false; }
+		if ( !rv )
+			unlinkat(w->dfd, w->tmp, 0);
+		}
+	if ( rv && opt_fsync == FSYNC_FULL && w->dfd >= 0 )
+		fsync(w->dfd); // the directory entry
+	w->fd = -1;
+	if ( !rv ) errno = e;
+	return rv;
+	}
+
+// copy contents of file (or stdin if NULL) to the note;
+// the data do not pass through user space (splice, copy_file_range)
+bool print_file_to(const char *file, nwriter_t *w) {
+	struct stat st;
+	ssize_t	bytes = -1;
+	int		in;
 	
-	if ( (input = (file) ? fopen(file, "r") : stdin) != NULL ) {	
-		while ( !feof(input) ) {
-			if ( (bytes = f_read(buf, 1, sizeof(buf), input)) > 0 )
-				f_write(buf, 1, bytes, output);
+	if ( (in = (file) ? open(file, O_RDONLY | O_CLOEXEC) : STDIN_FILENO) >= 0 ) {
+		if ( fstat(in, &st) == 0 )
+			bytes = fio_copyfd(in, w->fd, &st);
+		if ( bytes >= 0 ) {
+			tr_count(TR_READ, bytes);
+			if ( file ) close(in);
+			return true;
 			}
-		if ( file ) fclose(input);
-		return true;
+		if ( file ) { int e = errno; close(in); errno = e; }
 		}
-	else 
-		fprintf(stderr, "%s: errno %d: %s\n", file, errno, strerror(errno));
+	fprintf(stderr, "%s: errno %d: %s\n", (file) ? file : "stdin", errno, strerror(errno));
 	return false;
 	}
 
@@ -773,6 +1496,8 @@ bool print_file_to(const char *file, FILE *output) {
 void vexpand(char *buf) {
 	wordexp_t p;
 	
+	if ( !strpbrk(buf, "$~`\\\"' \t\n*?[]{}()|&;<>") ) // nothing to expand
+		return;
 	if ( wordexp(buf, &p, 0) == 0 ) {
 		strcpy(buf, "");
 		for ( int i = 0; i < p.we_wordc; i ++ )
@@ -795,25 +1520,31 @@ void normalize_section_name(char *section) {
 		}
 	}
 
-// if section does not exists, creates it
-void make_section(const char *sec) {
-	char dest[PATH_MAX];
+// if section does not exists, creates it; on error exits if 'fatal',
+// otherwise returns false
+bool make_section(const char *sec, bool fatal) {
+	struct stat st;
 
 	if ( strlen(sec) ) {
-		snprintf(dest, PATH_MAX, "%s/%s", ndir, sec);
-		if ( access(dest, X_OK) != 0 ) { // new section ?
-			if ( mkdir(dest, 0700) != 0 ) {
-				fprintf(stderr, "mkdir(%s): errno %d: %s\n", dest, errno, strerror(errno));
-				exit(EXIT_FAILURE);
-				}
+		if ( mkdirat(ndir_fd, sec, 0700) != 0 ) {
+			if ( errno == EEXIST && fstatat(ndir_fd, sec, &st, 0) == 0 && S_ISDIR(st.st_mode) )
+				return true;
+			if ( errno == EEXIST )
+				errno = ENOTDIR;
+			if ( !fatal )
+				return false;
+			fprintf(stderr, "mkdir(%s/%s): errno %d: %s\n", ndir, sec, errno, strerror(errno));
+			exit(EXIT_FAILURE);
 			}
 		}
+	return true;
 	}
 
 // create a note node
+// flags: 0x01 create the file, 0x02 returns NULL if the section cannot be created
 note_t*	make_note(const char *name, const char *defsec, int flags) {
 	note_t *note = (note_t *) m_alloc(sizeof(note_t));
-	FILE *fp;
+	int	fd, sfd;
 	const char *p;
 
 	if ( (p = strrchr(name, '/')) != NULL ) {
@@ -821,7 +1552,10 @@ note_t*	make_note(const char *name, const char *defsec, int flags) {
 		strncpy(note->section, name, p - name);
 		note->section[p - name] = '\0';
 		normalize_section_name(note->section);
-		make_section(note->section);
+		if ( !make_section(note->section, !(flags & 0x02)) ) {
+			m_free(note);
+			return NULL;
+			}
 		snprintf(note->file, PATH_MAX, "%s/%s/%s", ndir, note->section, note->name);
 		}
 	else {
@@ -829,7 +1563,10 @@ note_t*	make_note(const char *name, const char *defsec, int flags) {
 		if ( defsec && strlen(defsec) ) {
 			strcpy(note->section, defsec);
 			normalize_section_name(note->section);
-			make_section(note->section);
+			if ( !make_section(note->section, !(flags & 0x02)) ) {
+				m_free(note);
+				return NULL;
+				}
 			snprintf(note->file, PATH_MAX, "%s/%s/%s", ndir, note->section, note->name);
 			}
 		else {
@@ -845,12 +1582,15 @@ note_t*	make_note(const char *name, const char *defsec, int flags) {
 	
 	// create the file
 	if ( flags & 0x01 ) { // create file
+		sfd = section_fd(note->section);
 		if ( (opt_flags & OPT_ADD) && !(opt_flags & OPT_NOCLOB) && !(opt_flags & OPT_APPD) ) {
-			if ( access(note->file, F_OK) == 0 )
+			if ( faccessat(sfd, note_fname(note), F_OK, 0) == 0 ) {
+				m_free(note);
 				return NULL;
+				}
 			}
-		if ( (fp = fopen(note->file, "wt")) != NULL )
-			fclose(fp);
+		if ( (fd = openat(sfd, note_fname(note), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) >= 0 )
+			close(fd);
 		else {
 			m_free(note);
 			note = NULL;
@@ -859,24 +1599,181 @@ note_t*	make_note(const char *name, const char *defsec, int flags) {
 	return note;
 	}
 
-// === explorer =============================================================
-static note_t **t_notes;
-static int	t_notes_count;
-static list_t	*tagged;
-static WINDOW	*w_lst, *w_prv, *w_inf;
-typedef enum { ex_nav, ex_search } ex_mode_t;
+// restore the deleted notes of the trash that match the pattern;
+// 'rel' is the section, the notes are moved back to it
+int note_restore_walk(const char *trash, const char *rel, const char *pattern) {
+	char	path[PATH_MAX], name[NAME_MAX], *e;
+	struct dirent *entry;
+	struct stat st;
+	DIR		*dir;
+	int		count = 0;
 
-// short date
-const char *sdate(const time_t *t, char *buf) {
-	struct tm *tmp;
-	
-	tmp = localtime(t);
-	if ( tmp ) 
-		strftime(buf, 128, "%F %H:%M", tmp);
-	else
-		strcpy(buf, "* error *");
-	return buf;
-	}
+	snprintf(path, PATH_MAX, "%s%s%s", trash, (*rel) ? "/" : "", rel);
+	if ( !(dir = opendir(path)) )	return 0;
+	while ( (entry = readdir(dir)) != NULL ) {
+		if ( entry->d_name[0] == '.' ) // ., ..
+			continue;
+		if ( *rel )
+			snprintf(path, PATH_MAX, "%s/%s", rel, entry->d_name);
+		else
+			snprintf(path, PATH_MAX, "%s", entry->d_name);
+		if ( entry->d_type == DT_UNKNOWN ) {
+			if ( fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) )
+				entry->d_type = DT_DIR;
+			}
+		if ( entry->d_type == DT_DIR ) {
+			count += note_restore_walk(trash, path, pattern);
+			continue;
+			}
+		strcpy(name, entry->d_name);
+		if ( (e = strrchr(name, '.')) != NULL )
+			*e = '\0';
+		if ( fnmatch(pattern, name, FNM_PERIOD | FNM_CASEFOLD | FNM_GLIBC_EXTRA) != 0 )
+			continue;
+		if ( faccessat(ndir_fd, path, F_OK, AT_SYMLINK_NOFOLLOW) == 0 ) {
+			fprintf(stderr, "%s: already exists, not restored\n", path);
+			continue;
+			}
+		if ( make_section(rel, false) && fio_renameat(dirfd(dir), entry->d_name, section_fd(rel), entry->d_name) ) {
+			printf("* '%s%s%s' restored *\n", rel, (*rel) ? "/" : "", name);
+			count ++;
+			}
+		else
+			fprintf(stderr, "%s: errno %d: %s\n", path, errno, strerror(errno));
+		}
+	closedir(dir);
+	return count;
+	}
+
+// restore the deleted notes that match the pattern from the trash; the
+// backups are versions of the notes, a note that is not in the trash was
+// renamed or moved, not deleted.
+int note_restore(const char *pattern) {
+	char	trash[PATH_MAX];
+
+	if ( strlen(bdir) == 0 ) {
+		fprintf(stderr, "no backupdir defined\n");
+		return 0;
+		}
+	snprintf(trash, PATH_MAX, "%s/" TRASH_DIR, bdir);
+	return note_restore_walk(trash, "", pattern);
+	}
+
+// === configuration loading ================================================
+// notesrc is loaded at start and reloaded by the explorer when it changes;
+// then the variables and the colors that it does not set return to defaults.
+
+static void	*var_saved[sizeof(var_table) / sizeof(var_t)];
+static int	color_saved[sizeof(color_table) / sizeof(color_table[0])];
+
+// save the values of the variables and the colors, or restore them
+void conf_defaults(bool restore) {
+	for ( int i = 0; var_table[i].name; i ++ ) {
+		var_t *v = &var_table[i];
+		size_t size = ( v->type == 's' ) ? strlen((const char *) ((restore) ? var_saved[i] : v->value)) + 1
+			: ( v->type == 'f' ) ? sizeof(double) : sizeof(int);
+		if ( restore )
+			memcpy(v->value, var_saved[i], size);
+		else {
+			var_saved[i] = m_alloc(size);
+			memcpy(var_saved[i], v->value, size);
+			}
+		}
+	for ( int i = 0; color_table[i].key; i ++ ) {
+		if ( restore )
+			*(color_table[i].intptr) = color_saved[i];
+		else
+			color_saved[i] = *(color_table[i].intptr);
+		}
+	}
+
+// returns true if notesrc is changed since it was read
+bool conf_changed() {
+	struct stat st;
+
+	if ( stat(conf, &st) != 0 ) // missing, or being replaced
+		return false;
+	return !(st.st_dev == conf_st.st_dev && st.st_ino == conf_st.st_ino && st.st_size == conf_st.st_size
+		&& st.st_mtim.tv_sec == conf_st.st_mtim.tv_sec && st.st_mtim.tv_nsec == conf_st.st_mtim.tv_nsec);
+	}
+
+// load the configuration; notesrc, the default rules and the hooks
+void conf_load() {
+	exclude = list_create();
+	rules = list_create();
+	rule_other = list_create();
+	umenu = list_create();
+
+	read_conf(conf);
+
+	//
+	g_globber = ( strlen(sclob) ) ? istrue(sclob) : true;
+	opt_fsync = FSYNC_NONE;
+	if ( strlen(sfsync) ) {
+		if      ( strcasecmp(sfsync, "none") == 0 ) opt_fsync = FSYNC_NONE;
+		else if ( strcasecmp(sfsync, "data") == 0 ) opt_fsync = FSYNC_DATA;
+		else if ( strcasecmp(sfsync, "full") == 0 ) opt_fsync = FSYNC_FULL;
+		else fprintf(stderr, "rc: fsync: expected none, data or full [%s]\n", sfsync);
+		}
+
+	// setting up default pager and editor
+	char editor[PATH_MAX], pager[PATH_MAX], buf[PATH_MAX];
+	if ( getenv("NOTESPAGER") )
+		strcpy(pager, getenv("NOTESPAGER"));
+	else if ( getenv("PAGER") )
+		strcpy(pager, getenv("PAGER"));
+	else
+		strcpy(pager, "less");
+	
+	if ( getenv("NOTESEDITOR") )
+		strcpy(editor, getenv("NOTESEDITOR"));
+	else if ( getenv("EDITOR") )
+		strcpy(editor, getenv("EDITOR"));
+	else
+		strcpy(editor, "vi");
+
+	snprintf(buf, PATH_MAX, "view * %s %%f", pager);
+	rule_add(buf);
+	snprintf(buf, PATH_MAX, "edit * %s %%f", editor);
+	rule_add(buf);
+
+	// the hooks are parsed once
+	if ( strlen(onstart_cmd) ) onstart_sp = sp_parse(onstart_cmd);
+	if ( strlen(onexit_cmd) )  onexit_sp  = sp_parse(onexit_cmd);
+	}
+
+// free the configuration
+void conf_free() {
+	exclude = list_destroy(exclude);
+	for ( list_node_t *cur = rules->head; cur; cur = cur->next )
+		sp_free(((rule_t *) cur->data)->cmd);
+	rule_index_free();
+	rules = list_destroy(rules);
+	for ( list_node_t *cur = umenu->head; cur; cur = cur->next )
+		sp_free(((umenu_item_t *) cur->data)->sp);
+	umenu = list_destroy(umenu);
+	onstart_sp = sp_free(onstart_sp);
+	onexit_sp = sp_free(onexit_sp);
+	}
+
+// === explorer =============================================================
+static note_t **t_notes;
+static int	t_notes_count;
+static list_t	*tagged;
+static WINDOW	*w_lst, *w_prv, *w_inf;
+typedef enum { ex_nav, ex_search } ex_mode_t;
+
+// short date
+const char *sdate(const time_t *t, char *buf) {
+	struct tm *tmp;
+	
+	tmp = localtime(t);
+	if ( tmp ) 
+		strftime(buf, 128, "%F %H:%M", tmp);
+	else
+		strcpy(buf, "* error *");
+	return buf;
+	}
 
 // get a string value
 bool ex_input(char *buf, const char *prompt_fmt, ...) {
@@ -896,21 +1793,24 @@ bool ex_input(char *buf, const char *prompt_fmt, ...) {
 	}
 
 // print status line
+// 'bar' is a compiled format (i.e. the help bar), otherwise 'msg' is printed as it is
 static const char *vrt_ln = "┃";
-void ex_status_line(const char *fmt, ...) {
-	char	msg[LINE_MAX];
+static nc_fmt_t *ex_status_fmt;
+void ex_status_line(const nc_fmt_t *bar, const char *msg) {
 	int short pair;
-	va_list ap;
-	va_start(ap, fmt);
-	vsnprintf(msg, LINE_MAX, fmt, ap);
-	va_end(ap);
 	
+	if ( !ex_status_fmt )
+		ex_status_fmt = nc_compile("%6d %s ");
 	nc_setvgacolor(w_inf, clr_status & 0xf, clr_status >> 4);
 	wattr_get(w_inf, NULL, &pair, NULL);
 	wbkgdset(w_inf, COLOR_PAIR(pair));
 	werase(w_inf);
 	mvwhline(w_inf, 0, 0, ' ', getmaxx(w_inf));
-	nc_wprintf(w_inf, "%6d %s %s", list_count(notes), vrt_ln, msg);
+	nc_wputf(w_inf, ex_status_fmt, (int) list_count(notes), vrt_ln);
+	if ( bar )
+		nc_wputf(w_inf, bar);
+	else
+		waddstr(w_inf, msg);
 	wrefresh(w_inf);
 	}
 
@@ -946,6 +1846,7 @@ void ex_print_list(int offset, int pos) {
 	}
 
 // display the contents of the note (preview window)
+static nc_fmt_t *pv_head[4];	// compiled preview header
 void ex_print_note(const note_t *note) {
 	FILE	*fp;
 	char	buf[LINE_MAX];
@@ -959,17 +1860,23 @@ void ex_print_note(const note_t *note) {
 	wmove(w_prv, 0, 0);
 	if ( note ) {
 		if ( opt_pv_filestat ) {
-			nc_wprintf(w_prv, "Name: $B%s$b", note->name);
+			if ( !pv_head[0] ) {
+				pv_head[0] = nc_compile("Name: $B%s$b");
+				pv_head[1] = nc_compile(", Section: $B%s$b");
+				pv_head[2] = nc_compile("\nFile: $B%s$b\nDate: $B%s$b\n");
+				pv_head[3] = nc_compile("Stat: $B%6ld$b bytes, mode $B0%o$b, owner $B%d$b:$B%d$b\n");
+				}
+			nc_wputf(w_prv, pv_head[0], note->name);
 			if ( strlen(note->section) )
-				nc_wprintf(w_prv, ", Section: $B%s$b", note->section);
-			nc_wprintf(w_prv, "\nFile: $B%s$b\n", note->file);
-			nc_wprintf(w_prv, "Date: $B%s$b\n", sdate(&note->st.st_mtime, buf));
-			nc_wprintf(w_prv, "Stat: $B%6d$b bytes, mode $B0%o$b, owner $B%d$b:$B%d$b\n",
-				note->st.st_size, note->st.st_mode & 0777, note->st.st_uid, note->st.st_gid);
+				nc_wputf(w_prv, pv_head[1], note->section);
+			nc_wputf(w_prv, pv_head[2], note->file, sdate(&note->st.st_mtime, buf));
+			nc_wputf(w_prv, pv_head[3], (long) note->st.st_size,
+				(unsigned) note->st.st_mode & 0777, (int) note->st.st_uid, (int) note->st.st_gid);
 			for ( int i = 0; i < getmaxx(w_prv); i ++ ) wprintw(w_prv, "─");
 			}
-		if ( (fp = fopen(note->file, "rt")) != NULL ) {
+		if ( (fp = note_fopen(note)) != NULL ) {
 			while ( fgets(buf, LINE_MAX, fp) ) {
+				tr_count(TR_READ, strlen(buf));
 				if ( strcmp(note->ftype, "md") == 0 ) {
 					int		i, color = clr_text;
 					
@@ -1018,7 +1925,7 @@ static int t_str_cmp(const void *va, const void *vb) {
 
 // help
 static char *ex_help_s = "&? help, &quit, &view, &edit, &rename, &delete, &new, &/ search, &section, &tag, &untag all";
-static char ex_help[LINE_MAX];
+static nc_fmt_t *ex_help_bar;	// compiled ex_help_s
 static char *ex_help_long = "\
 ?, F1  ... Help. This window.\n\
 q, ^Q  ... Quit. Terminates the program.\n\
@@ -1038,6 +1945,7 @@ m, F2  ... Menu. Open the user-defined menu.\n\
 !, x, F10  Execute something with current/tagged notes[1].\n\
 f      ... Open the notes directory with the file manager.\n\
 F5     ... Rebuild & redraw the list.\n\
+L, F12 ... Frame latency. Histograms of the time from a key to the painted screen.\n\
 \n\
 Notes:\n\
 [1] The tagged notes if there are any, otherwise the current note.\n\
@@ -1046,27 +1954,37 @@ Notes:\n\
 ";
 //f      ... Set Filter[1].\n
 
-// build the table with notes
-bool ex_build() {
-	if ( notes )
-		list_clear(notes);
-	if ( strlen(current_section) ) {
-		char path[PATH_MAX];
-		snprintf(path, PATH_MAX, "%s/%s", ndir, current_section);
-		dirwalk(path);
-		}
-	else	
-		dirwalk(ndir);
+// build the table from the notes list
+bool ex_table() {
+	int		tr;
+
 	t_notes = (note_t **) list_to_table(notes);
 	t_notes_count = list_count(notes);
 	if ( t_notes_count == 0 )
 		return false;
+	tr = tr_begin("qsort");
 	qsort(t_notes, t_notes_count, sizeof(note_t*), t_notes_cmp);
+	tr_end(tr);
 	return true;
 	}
 
+// build the table with notes
+bool ex_build() {
+	int		tr = tr_begin("ex_build"), tw = tr_begin("dirwalk");
+	bool	rv;
+
+	if ( notes )
+		list_clear(notes);
+	dirwalk(current_section);
+	tr_end(tw);
+	rv = ex_table();
+	tr_end(tr);
+	return rv;
+	}
+
 // rebuild the table with notes
 bool ex_rebuild() {
+	section_fd_flush();
 	m_free(t_notes);
 	return ex_build();
 	}
@@ -1108,8 +2026,8 @@ int	ex_find(const char *name) {
 	return -1;
 	}
 
-//
-void ex_colorize(char *dest, const char *src) {
+// converts '&x' to escape-codes of colored 'x'
+void ex_colorize_str(char *dest, const char *src) {
 	const char *p = src, *e;
 	char *d = dest;
 	char cstart[16], cend[16];
@@ -1140,6 +2058,13 @@ void ex_colorize(char *dest, const char *src) {
 	*d = '\0';
 	}
 
+// converts '&x' to colored 'x' and compiles the result
+nc_fmt_t *ex_colorize(const char *src) {
+	char buf[LINE_MAX];
+	ex_colorize_str(buf, src);
+	return nc_compile(buf);
+	}
+
 bool ex_select_section(char *result, const char *default_value) {
 	int i = 0, r = false;
 	char **table = (char **) list_to_table(sections);
@@ -1162,31 +2087,116 @@ bool ex_select_section(char *result, const char *default_value) {
 	return r;
 	}
 
-//
-void vstrcat(char *buf, ...) {
-	va_list ap;
-	const char *s;
+// execute the command for the tagged notes
+int ex_tagged_shell(const sp_cmd_t *cmd, list_t *tagged) {
+	const char **files = (const char **) m_alloc(sizeof(char *) * (list_count(tagged) + 1));
+	size_t root_dir_len = strlen(ndir) + 1;
+	int		count = 0, rv;
 
-	va_start(ap, buf);
-	while ( (s = va_arg(ap, const char *)) != NULL )
-		strcat(buf, s);
-	va_end(ap);
+	for ( list_node_t *cur = tagged->head; cur; cur = cur->next )
+		files[count ++] = ((note_t *) (cur->data))->file + root_dir_len;
+	rv = note_shell(cmd, files, count);
+	m_free(files);
+	return rv;
 	}
 
-//
-int ex_tagged_shell(const char *cmd, list_t *tagged) {
-	char files[LINE_MAX];
-	const char *p;
-	size_t root_dir_len = strlen(ndir) + 1;
+// execute the rules for the tagged notes, one process per rule
+int ex_tagged_rule(int action, list_t *tagged) {
+	const char **files = (const char **) list_to_table(tagged);
+	int		count = list_count(tagged), rv;
+
+	for ( int i = 0; i < count; i ++ )
+		files[i] = ((const note_t *) files[i])->file;
+	rv = rule_exec_list(action, files, count);
+	m_free(files);
+	return rv;
+	}
+
+// returns true if an exclude pattern matches the note or its directories, under the section
+bool ex_excluded(const note_t *note) {
+	char	path[PATH_MAX], *p, *sp;
+	size_t	skip = strlen(ndir) + 1;
+
+	if ( *current_section )
+		skip += strlen(current_section) + 1;
+	if ( strlen(note->file) <= skip )
+		return false;
+	strcpy(path, note->file + skip);
+	for ( p = strtok_r(path, "/", &sp); p; p = strtok_r(NULL, "/", &sp) )
+		if ( !dirwalk_checkfn(p) )
+			return true;
+	return false;
+	}
+
+// reload notesrc if it is changed; returns true if reloaded.
+// the notebook remains; the notes are scanned again only if an exclude
+// pattern is removed, new patterns just drop the matching notes.
+bool ex_reload() {
+	char	sndir[PATH_MAX], sbdir[PATH_MAX];
+	list_t	*old_excl;
+	list_node_t *cur, *next, *node;
+	bool	rescan = false;
 
-	files[0] = '\0';
-	for ( list_node_t *cur = tagged->head; cur; cur = cur->next ) {
-		p = ((note_t *) (cur->data))->file;
-		if ( cur != tagged->head ) // add separator
-			strcat(files, " ");
-		vstrcat(files, "'", p + root_dir_len, "'", NULL);
+	if ( !conf_changed() )
+		return false;
+
+	// new configuration
+	strcpy(sndir, ndir);
+	strcpy(sbdir, bdir);
+	old_excl = list_create();
+	for ( cur = exclude->head; cur; cur = cur->next )
+		list_addstr(old_excl, (const char *) cur->data);
+	conf_free();
+	nc_clearkeys();
+	conf_defaults(true);
+	conf_load();
+	strcpy(ndir, sndir);
+	strcpy(bdir, sbdir);
+	section_fd_flush();
+	set_default_keymap();
+	nc_addkey("input", KEY_CANCEL, 3);
+	ex_help_bar = nc_fmt_free(ex_help_bar);
+	ex_help_bar = ex_colorize(ex_help_s);
+
+	// notes
+	for ( cur = old_excl->head; cur; cur = cur->next )
+		if ( list_findstr(exclude, (const char *) cur->data) == NULL )
+			rescan = true;
+	if ( rescan ) {
+		list_clear(tagged);
+		ex_rebuild();
+		}
+	else if ( list_count(exclude) != list_count(old_excl) ) {
+		for ( cur = notes->head; cur; cur = next ) {
+			next = cur->next;
+			if ( ex_excluded((const note_t *) cur->data) ) {
+				if ( (node = list_findptr(tagged, cur->data)) != NULL )
+					list_delete(tagged, node);
+				list_delete(notes, cur);
+				}
+			}
+		m_free(t_notes);
+		ex_table();
 		}
-	return note_shell(cmd, files);
+	old_excl = list_destroy(old_excl);
+	return true;
+	}
+
+// frame latency, from the return of the key to the painted screen;
+// the frames of the keys that run a program are not counted
+static tr_hist_t ex_lat_frame, ex_lat_list, ex_lat_note, ex_lat_status;
+
+// display the histograms of the frame latency
+void ex_latency() {
+	char	buf[16384];
+	size_t	len;
+
+	len  = strlen(tr_hist_print(NULL, NULL, false, buf, sizeof(buf)));
+	len += strlen(tr_hist_print(&ex_lat_list, "list", false, buf + len, sizeof(buf) - len));
+	len += strlen(tr_hist_print(&ex_lat_note, "preview", false, buf + len, sizeof(buf) - len));
+	len += strlen(tr_hist_print(&ex_lat_status, "status", false, buf + len, sizeof(buf) - len));
+	tr_hist_print(&ex_lat_frame, "frame", true, buf + len, sizeof(buf) - len);
+	nc_view("Frame latency", buf);
 	}
 
 //
@@ -1214,9 +2224,19 @@ void explorer() {
 	bool	insert = true;
 	ex_mode_t mode = ex_nav;
 	const char *term;
+	nc_keymap_t *km_nav, *km_input;
+	hook_t	onstart;
+	int		hook_st;
+	long long t_key = 0, t;		// the return of the key, 0 = none
+	unsigned long spawned = 0;
 	
-	if ( strlen(onstart_cmd) )
-		system(onstart_cmd);
+	// onstart runs while the notes are scanned; they are scanned again when completed
+	onstart.pid = 0;
+	onstart.out = -1;
+	if ( onstart_sp ) {
+		if ( opt_hookwait || !hook_start(&onstart, onstart_sp, false) )
+			hook_run(onstart_sp);
+		}
 
 	ex_build();
 	tagged = list_create();
@@ -1225,6 +2245,8 @@ void explorer() {
 	raw();
 	set_default_keymap();
 	nc_addkey("input", KEY_CANCEL, 3);
+	km_nav   = nc_keymap("nav");
+	km_input = nc_keymap("input");
 	if ( (term = getenv("TERM")) != NULL ) {
 		if ( strncmp(term, "xterm", 5) == 0 ) {
 			define_key("\033[1~", KEY_HOME);
@@ -1232,7 +2254,11 @@ void explorer() {
 			}
 		}
 	ex_build_windows();
-	ex_colorize(ex_help, ex_help_s);
+	ex_help_bar = ex_colorize(ex_help_s);
+	tr_hist_report("frame", &ex_lat_frame);
+	tr_hist_report("list", &ex_lat_list);
+	tr_hist_report("preview", &ex_lat_note);
+	tr_hist_report("status", &ex_lat_status);
 	
 	status[0]  = '\0';
 	search[0]  = '\0';
@@ -1242,30 +2268,76 @@ void explorer() {
 	do {
 		lines = getmaxy(stdscr) - 2;
 		fix_offset();
+		int tr = tr_begin("ex_print_list");
+		t = tr_now();
 		ex_print_list(offset, pos);
-		if ( t_notes_count )
+		if ( t_key ) tr_hist_add(&ex_lat_list, tr_now() - t);
+		tr_end(tr);
+		if ( t_notes_count ) {
+			tr = tr_begin("ex_print_note");
+			t = tr_now();
 			ex_print_note(t_notes[pos]);
+			if ( t_key ) tr_hist_add(&ex_lat_note, tr_now() - t);
+			tr_end(tr);
+			}
+		t = tr_now();
 		
 		if ( mode == ex_search ) {
-			ex_status_line("%s", search);
+			ex_status_line(NULL, search);
 			wmove(w_inf, 0, spos+(INF_PREFIX-1));
 			}
 		else if ( status[0] == '\0' )
-			ex_status_line("%s", ex_help);
+			ex_status_line(ex_help_bar, NULL);
 		else {
-			ex_status_line("%s", status);
+			ex_status_line(NULL, status);
 			if ( keep_status )
 				keep_status --;
 			else
 				status[0] = '\0';
 			}
+		if ( t_key ) { // the frame is painted
+			long long now = tr_now();
+			tr_hist_add(&ex_lat_status, now - t);
+			if ( tr_counter[TR_SPAWN] == spawned )
+				tr_hist_add(&ex_lat_frame, now - t_key);
+			t_key = 0;
+			}
 		
-		// read key
+		// read key; polls the onstart hook while it runs
+		// and notesrc for changes
+		wtimeout(w_inf, ( onstart.pid ) ? 250 : 1000);
 		ch = wgetch(w_inf);
+		if ( ch != ERR ) {
+			t_key = tr_now();
+			spawned = tr_counter[TR_SPAWN];
+			}
+		if ( onstart.pid ) {
+			if ( hook_done(&onstart, &hook_st) ) {
+				if ( hook_st == 0 )
+					sprintf(status, "onstart: completed in %ds.", (int) (time(NULL) - onstart.start));
+				else
+					sprintf(status, "onstart: failed (exit %d) %.200s", hook_st, onstart.line);
+				keep_status = 1;
+				list_clear(tagged); // the notes are freed
+				ex_rebuild();
+				if ( pos >= t_notes_count ) pos = t_notes_count - 1;
+				if ( pos < 0 ) pos = 0;
+				}
+			else if ( mode == ex_nav && (status[0] == '\0' || ch == ERR) ) {
+				snprintf(status, LINE_MAX, "onstart: running %ds %.200s", (int) (time(NULL) - onstart.start), onstart.line);
+				keep_status = 0;
+				}
+			}
+		if ( mode == ex_nav && ex_reload() ) {
+			strcpy(status, "notesrc: reloaded.");
+			ex_refresh(); // the colors
+			}
+		if ( ch == ERR )
+			continue;
 
 		// input string mode
 		if ( mode == ex_search ) {
-			pf = nc_getprg("input", ch);
+			pf = nc_mapprg(km_input, ch);
 			wchar_t wch = (wchar_t) ch;
 			if ( u8ischar(ch) ) {
 				char mbs[7];
@@ -1343,7 +2415,7 @@ void explorer() {
 
 		// navigation mode
 		else if ( mode == ex_nav ) {
-			pf = nc_getprg("nav", ch);
+			pf = nc_mapprg(km_nav, ch);
 //			fprintf(stderr, "%04X %04X %d\n", pf, ch, ch);
 			switch ( KPRG_KEY(pf) ) {
 			case KEY_RESIZE:
@@ -1358,6 +2430,12 @@ void explorer() {
 			case KEY_HELP:
 				nc_view("Help", ex_help_long);
 				ex_refresh();
+				t_key = 0;
+				break;
+			case 'L': // frame latency
+				ex_latency();
+				ex_refresh();
+				t_key = 0;
 				break;
 			case KEY_UP:
 				if ( t_notes_count )
@@ -1417,7 +2495,7 @@ void explorer() {
 				if ( t_notes_count ) {
 					ex_presh();
 					if ( list_count(tagged) )
-						ex_tagged_shell("$PAGER %f", tagged);
+						ex_tagged_rule('v', tagged);
 					else
 						rule_exec('v', t_notes[pos]->file);
 					ex_refresh();
@@ -1443,7 +2521,7 @@ void explorer() {
 				if ( t_notes_count ) {
 					ex_presh();
 					if ( list_count(tagged) )
-						ex_tagged_shell("$EDITOR %f", tagged);
+						ex_tagged_rule('e', tagged);
 					else
 						rule_exec('e', t_notes[pos]->file);
 					ex_refresh();
@@ -1488,7 +2566,7 @@ void explorer() {
 						
 						if ( new_section ) { // name its ok, continue
 							normalize_section_name(new_section);
-							make_section(new_section);
+							make_section(new_section, true);
 								
 							// add the current element to tagged list
 							if ( !list_count(tagged) )
@@ -1500,7 +2578,7 @@ void explorer() {
 								note_t *cn = (note_t *) cur->data;
 								note_backup(cn);
 								note_t *nn = make_note(cn->name, new_section, 0);
-								if ( rename(cn->file, nn->file) != 0 ) {
+								if ( renameat(section_fd(cn->section), note_fname(cn), section_fd(nn->section), note_fname(nn)) != 0 ) {
 									sprintf(status, "move failed");
 									fail ++;
 									}
@@ -1537,8 +2615,8 @@ void explorer() {
 				int idx = nc_listbox("File Manager", (const char **) fmans, 0);
 				if ( idx > -1 ) {
 					ex_presh();
-					sprintf(buf, "%s '%s'", fmans[idx], ndir);
-					system(buf);
+					char *argv[] = { fmans[idx], ndir, NULL };
+					sp_spawn(argv);
 					}
 				ex_refresh();
 				break;
@@ -1579,13 +2657,13 @@ void explorer() {
 					if ( ex_input(buf, "Enter the new name ([section/]new-name[.extension])", t_notes[pos]->name)
 							&& strlen(buf)
 							&& strcmp(buf, t_notes[pos]->name) != 0 ) {
-						note_backup(t_notes[pos]);
-						note_t *nn = make_note(buf, t_notes[pos]->section, 1);
-						if ( !copy_file(t_notes[pos]->file, nn->file) )
-							sprintf(status, "copy failed");
-						else {
-							if ( remove(t_notes[pos]->file) != 0 )
-								sprintf(status, "delete old note failed");
+						note_t *nn = make_note(buf, t_notes[pos]->section, 0);
+						if ( !fio_renameat(section_fd(t_notes[pos]->section), note_fname(t_notes[pos]),
+								section_fd(nn->section), note_fname(nn)) ) {
+							if ( errno == EEXIST )
+								sprintf(status, "'%s' already exists", buf);
+							else
+								sprintf(status, "rename failed: %s", strerror(errno));
 							}
 						m_free(nn);
 						ex_rebuild();
@@ -1606,7 +2684,7 @@ void explorer() {
 							list_addptr(tagged, t_notes[pos]);
 						
 						ex_presh();
-						ex_tagged_shell(opts[idx]->cmd, tagged);
+						ex_tagged_shell(opts[idx]->sp, tagged);
 						printf("\nPress any key to return...\n");
 						getch();
 						if ( !tcnt )
@@ -1624,8 +2702,10 @@ void explorer() {
 						int tcnt = list_count(tagged);
 						if ( !tcnt )
 							list_addptr(tagged, t_notes[pos]);
+						sp_cmd_t *sp = sp_parse(cmd);
 						ex_presh();
-						ex_tagged_shell(cmd, tagged);
+						ex_tagged_shell(sp, tagged);
+						sp_free(sp);
 						printf("\nPress any key to return...\n");
 						getch();
 						if ( !tcnt )
@@ -1660,8 +2740,14 @@ void explorer() {
 	nc_close();
 	tagged = list_destroy(tagged);
 	m_free(t_notes);
-	if ( strlen(onexit_cmd) )
-		system(onexit_cmd);
+	ex_help_bar = nc_fmt_free(ex_help_bar);
+	if ( onstart.out >= 0 ) // if still running, let it complete
+		close(onstart.out);
+	if ( onexit_sp ) {
+		hook_t onexit;
+		if ( opt_hookwait || !hook_start(&onexit, onexit_sp, true) )
+			hook_run(onexit_sp);
+		}
 	}
 
 // === main =================================================================
@@ -1671,11 +2757,9 @@ void explorer() {
 
 // initialization
 void init() {
-	exclude = list_create();
-	rules = list_create();
-	umenu = list_create();
 	notes = list_create();
 	sections = list_create();
+	secfds = list_create();
 	
 	// default values
 	strcpy(default_ftype, "txt");
@@ -1698,93 +2782,82 @@ void init() {
 		if ( access(conf, R_OK) != 0 )
 			sprintf(conf, "%s/.notesrc", home);
 		}
+	if ( *conf != '/' ) { // it is checked for changes after chdir
+		char	path[PATH_MAX];
+		if ( realpath(conf, path) )
+			strcpy(conf, path);
+		}
 
 	// read config file
-	read_conf(conf);
+	conf_defaults(false);
+	conf_load();
 	
 	// expand
+	int tr = tr_begin("vexpand");
 	vexpand(ndir);
 	vexpand(bdir);
+	tr_end(tr);
 
 	//
 	if ( access(ndir, X_OK) != 0 )
 		mkdir(ndir, 0700);
 	chdir(ndir);
-	
-	//
-	if ( strlen(sclob) ) {
-		if ( istrue(sclob) )
-			g_globber = true;
-		else
-			g_globber = false;
-		}
-
-	// setting up default pager and editor
-	char editor[PATH_MAX], pager[PATH_MAX], buf[PATH_MAX];
-	if ( getenv("NOTESPAGER") )
-		strcpy(pager, getenv("NOTESPAGER"));
-	else if ( getenv("PAGER") )
-		strcpy(pager, getenv("PAGER"));
-	else
-		strcpy(pager, "less");
-	
-	if ( getenv("NOTESEDITOR") )
-		strcpy(editor, getenv("NOTESEDITOR"));
-	else if ( getenv("EDITOR") )
-		strcpy(editor, getenv("EDITOR"));
-	else
-		strcpy(editor, "vi");
-
-	snprintf(buf, PATH_MAX, "view * %s %%f", pager);
-	rule_add(buf);
-	snprintf(buf, PATH_MAX, "edit * %s %%f", editor);
-	rule_add(buf);
+	if ( (ndir_fd = open(ndir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )
+		ndir_fd = AT_FDCWD;
 	}
 
 //
 void cleanup() {
-	exclude = list_destroy(exclude);
-	rules = list_destroy(rules);
-	umenu = list_destroy(umenu);
+	conf_free();
+	for ( int i = 0; var_table[i].name; i ++ )
+		if ( var_saved[i] ) m_free(var_saved[i]);
+
+	ex_status_fmt = nc_fmt_free(ex_status_fmt);
+	for ( int i = 0; i < 4; i ++ )
+		pv_head[i] = nc_fmt_free(pv_head[i]);
+
 	notes = list_destroy(notes);
 	sections = list_destroy(sections);
+	section_fd_close();
+	secfds = list_destroy(secfds);
 	}
 
-#define APP_DESCR \
-"notes - notes manager"
-
-#define APP_VER "1.6"
-
 static const char *usage = "\
 "APP_DESCR"\n\
-Usage: notes [mode] [options] [-s section] {note|pattern} [-|file(s)]\n\
+Usage: notes [mode] [options] [-s section ...] {note|pattern ...} [-|file(s)]\n\
 \n\
 Modes:\n\
     -a, --add      add a new note; use `!' to replace an existing note. \n\
     -a+, --append  append to a note; use `!' to create one if it does not exist.\n\
     -l, --list     list notes ('*' displays all)\n\
     -f, --files    same as list but displays only full pathnames (for scripts)\n\
+    -0, --null     same as list but the records are terminated by NUL (for scripts)\n\
+    --json         same as list but prints a JSON object per note (for scripts)\n\
     -v, --view     sends the note[s] to the $PAGER (see --all)\n\
     -p, --print    display the contents of a note[s] (see --all)\n\
     -e, --edit     load note[s] to $EDITOR (see --all)\n\
     -d, --delete   delete a note\n\
     -r, --rename   rename or move a note\n\
+    --restore      restore deleted note[s] from the trash\n\
+    --batch        execute the commands of stdin (add, append, delete, move, print)\n\
     -c, --rcfile   use this config file\n\
 \n\
 Options:\n\
-    -s, --section  define section\n\
+    -s, --section  define section; can be repeated\n\
     -a, --all      displays all matching files; use it with -p, -v or -e\n\
     -              input from stdin\n\
 \n\
 Utilities:\n\
     --onstart      executes the 'onstart' command and returns its exit code\n\
     --onexit       executes the 'onexit' command and returns its exit code\n\
+    --daemon       keeps the index in memory for the other instances\n\
+    --complete     prints the section/name of the notes that start with the prefix\n\
+    --trace[=file] prints the time and the counters of the phases at exit\n\
 \n\
     -h, --help     this screen\n\
     --version      version and program information\n\
 ";
 //    WIP --cleanup      removes empty sections\n
-//    WIP --complete     list notes for scripts (completion code)\n
 
 static const char *verss = "\
 notes version "APP_VER"\n\
@@ -1798,29 +2871,853 @@ There is NO WARRANTY, to the extent permitted by law.\n\
 Written by Nicholas Christopoulos <mailto:nereus@freemail.gr>\n\
 ";
 
+// command-line matching
+static list_t	*cli_pats;		// the patterns, any of them
+static list_t	*cli_secs;		// the sections (-s), any of them or all if empty
+static list_t	*cli_res;		// results
+
+// returns true if the matched notes are listed
+bool cli_listing() {
+	return (opt_flags & OPT_LIST) || (opt_flags & OPT_AUTO) || (opt_flags & OPT_FILES);
+	}
+
+// returns true if the listing does not need the whole scan (no column widths)
+bool cli_streaming() {
+	return (opt_flags & OPT_FILES) || opt_out != OUT_TEXT;
+	}
+
+// the completion key of the note, section/name
+const char *note_key(const note_t *note, char *buf) {
+	if ( note->section[0] == '\0' )
+		return note->name;
+	snprintf(buf, PATH_MAX, "%s/%s", note->section, note->name);
+	return buf;
+	}
+
+// returns true if the note matches the pattern; a pattern with '/' is matched with section/name
+bool note_match(const note_t *note, const char *pat) {
+	char	buf[PATH_MAX];
+	const char *key = ( strchr(pat, '/') ) ? note_key(note, buf) : note->name;
+	tr_count(TR_FNMATCH, 1);
+	return (fnmatch(pat, key, FNM_PERIOD | FNM_CASEFOLD | FNM_GLIBC_EXTRA) == 0);
+	}
+
+// dirwalk hook; collect the matched notes and print them if can
+void cli_match(note_t *note) {
+	list_node_t *cur;
+
+	if ( cli_secs->head ) {
+		for ( cur = cli_secs->head; cur; cur = cur->next )
+			if ( strcmp((const char *) cur->data, note->section) == 0 )
+				break;
+		if ( !cur )
+			return;
+		}
+	for ( cur = cli_pats->head; cur; cur = cur->next ) {
+		if ( note_match(note, (const char *) cur->data) ) { // once per note
+			if ( cli_listing() && cli_streaming() )
+				note_pl(note, 0);
+			list_addptr(cli_res, note);
+			return;
+			}
+		}
+	}
+
+// === direct lookup ========================================================
+// a pattern without wildcards is matched only by the notes of its section;
+// the directory of the one -s section, or the directories that match the
+// section of 'section/name' (case-insensitive, as the scan). only these
+// directories are read and their notes pass through cli_match() as in the
+// scan, so the result is the same without walking the notebook.
+
+// add to 'dirs' the directories under 'rel' that match the 'sec' path
+static void cli_lookup_dirs(const char *rel, const char *sec, list_t *dirs) {
+	char	comp[NAME_MAX], path[PATH_MAX];
+	const char *rest;
+	struct dirent *entry;
+	struct stat st;
+	DIR		*dir;
+	int		fd;
+
+	if ( *sec == '\0' ) {
+		if ( list_findstr(dirs, rel) == NULL )
+			list_addstr(dirs, rel);
+		return;
+		}
+	rest = sec + strcspn(sec, "/");
+	snprintf(comp, NAME_MAX, "%.*s", (int) (rest - sec), sec);
+	if ( *rest ) rest ++;
+	if ( (fd = openat(ndir_fd, (*rel) ? rel : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 )
+		return;
+	if ( !(dir = fdopendir(fd)) ) {
+		close(fd);
+		return;
+		}
+	while ( (entry = readdir(dir)) != NULL ) {
+		if ( !dirwalk_checkfn(entry->d_name) )
+			continue;
+		if ( entry->d_type == DT_UNKNOWN ) {
+			tr_count(TR_STAT, 1);
+			if ( fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) )
+				entry->d_type = DT_DIR;
+			}
+		tr_count(TR_FNMATCH, 1);
+		if ( entry->d_type != DT_DIR || fnmatch(comp, entry->d_name, FNM_PERIOD | FNM_CASEFOLD | FNM_GLIBC_EXTRA) != 0 )
+			continue;
+		if ( *rel )
+			snprintf(path, PATH_MAX, "%s/%s", rel, entry->d_name);
+		else
+			snprintf(path, PATH_MAX, "%s", entry->d_name);
+		cli_lookup_dirs(path, rest, dirs);
+		}
+	closedir(dir);
+	}
+
+// collects the notes of the patterns by their sections; returns false
+// if a pattern can be anywhere, or if more than one note is listed in
+// columns, and the notebook must be scanned.
+bool cli_lookup() {
+	char	section[PATH_MAX];
+	list_t	*dirs;
+	list_node_t *cur;
+	const char *pat, *p;
+	int		tr;
+
+	if ( (opt_flags & OPT_LIST) && !cli_streaming() ) // the width of the column is of all the sections
+		return false;
+	for ( cur = cli_pats->head; cur; cur = cur->next ) {
+		pat = (const char *) cur->data;
+		if ( *pat == '\0' || strpbrk(pat, "*?[\\") )
+			return false;
+		if ( strchr(pat, '/') ? cli_secs->head != NULL : list_count(cli_secs) != 1 )
+			return false;
+		}
+
+	tr = tr_begin("lookup");
+	dirs = list_create();
+	for ( cur = cli_pats->head; cur; cur = cur->next ) {
+		pat = (const char *) cur->data;
+		if ( (p = strrchr(pat, '/')) != NULL ) {
+			snprintf(section, PATH_MAX, "%.*s", (int) (p - pat), pat);
+			cli_lookup_dirs("", section, dirs);
+			}
+		else if ( list_findstr(dirs, (const char *) cli_secs->head->data) == NULL )
+			list_addstr(dirs, (const char *) cli_secs->head->data);
+		}
+	for ( cur = dirs->head; cur; cur = cur->next )
+		dirwalk_at((const char *) cur->data, false);
+	dirs = list_destroy(dirs);
+	tr_end(tr);
+	if ( cli_listing() && !cli_streaming() && list_count(cli_res) > 1 ) { // a list, aligned to all the sections
+		list_clear(cli_res);
+		list_clear(notes);
+		list_clear(sections);
+		return false;
+		}
+	return true;
+	}
+
+// === batch ================================================================
+// 'notes --batch' executes a stream of commands from stdin:
+//
+//	add LENGTH NAME				new note, LENGTH bytes of contents follow the record
+//	append LENGTH NAME			append LENGTH bytes that follow the record
+//	delete NAME
+//	move NAME NEW-NAME
+//	print NAME					the status is followed by LENGTH bytes of contents
+//
+// the fields are separated by blanks and the records end with new-line, or
+// with '-0' each field ends with NUL. NAME is a pattern as in command-line,
+// commands act on the first match. per command a status record is written,
+// "SEQ ok [LENGTH]" or "SEQ error MESSAGE".
+
+static bool bt_eor;		// end of record (line mode)
+
+// read the next field of the record; returns false at the end of record or file
+bool bt_field(FILE *in, char *buf, size_t size, bool nul) {
+	size_t	len = 0;
+	int		c;
+
+	if ( nul ) {
+		while ( (c = getc_unlocked(in)) != EOF && c != '\0' )
+			if ( len < size - 1 ) buf[len ++] = c;
+		buf[len] = '\0';
+		return ( c != EOF || len );
+		}
+	if ( bt_eor )
+		return false;
+	while ( (c = getc_unlocked(in)) == ' ' || c == '\t' || c == '\r' );
+	while ( c != EOF && c != '\n' && c != ' ' && c != '\t' && c != '\r' ) {
+		if ( len < size - 1 ) buf[len ++] = c;
+		c = getc_unlocked(in);
+		}
+	while ( c == ' ' || c == '\t' || c == '\r' ) // to the next field
+		c = getc_unlocked(in);
+	if ( c == '\n' || c == EOF )
+		bt_eor = true;
+	else
+		ungetc(c, in);
+	buf[len] = '\0';
+	return ( len > 0 );
+	}
+
+// skip the rest of the record
+void bt_skip(FILE *in, bool nul) {
+	int	c;
+	if ( !nul ) {
+		while ( !bt_eor && (c = getc_unlocked(in)) != EOF && c != '\n' );
+		bt_eor = true;
+		}
+	}
+
+// copy 'len' bytes of the input to 'fd' (or discard them if fd < 0)
+bool bt_copy(FILE *in, int fd, size_t len) {
+	char	buf[0x10000];
+	size_t	n;
+	ssize_t	w;
+	bool	ok = true;
+
+	while ( len ) {
+		if ( (n = fread(buf, 1, (len < sizeof(buf)) ? len : sizeof(buf), in)) == 0 ) {
+			errno = EIO; // short payload
+			return false;
+			}
+		len -= n;
+		for ( char *p = buf; ok && fd >= 0 && n; p += w, n -= w ) {
+			if ( (w = write(fd, p, n)) < 0 ) {
+				if ( errno == EINTR ) { w = 0; continue; }
+				ok = false;
+				}
+			}
+		}
+	return ok;
+	}
+
+// status record
+void bt_status(int seq, bool nul, const char *fmt, ...) {
+	char	buf[LINE_MAX];
+	va_list	ap;
+	int		len;
+
+	len = snprintf(buf, LINE_MAX, "%d ", seq);
+	va_start(ap, fmt);
+	len += vsnprintf(buf + len, LINE_MAX - len, fmt, ap);
+	va_end(ap);
+	if ( len >= LINE_MAX - 1 ) len = LINE_MAX - 2;
+	buf[len ++] = ( nul ) ? '\0' : '\n';
+	ob_write(buf, len);
+	}
+
+// returns the first note that matches the pattern
+list_node_t *bt_find(const char *pat) {
+	for ( list_node_t *cur = notes->head; cur; cur = cur->next )
+		if ( note_match((note_t *) cur->data, pat) )
+			return cur;
+	return NULL;
+	}
+
+// print the contents of the note with its length
+bool bt_print(int seq, const note_t *note, bool nul) {
+	struct stat st;
+	char	buf[0x10000];
+	size_t	left, n;
+	FILE	*fp;
+
+	if ( (fp = note_fopen(note)) == NULL || fstat(fileno(fp), &st) != 0 ) {
+		if ( fp ) fclose(fp);
+		return false;
+		}
+	bt_status(seq, nul, "ok %lld", (long long) st.st_size);
+	for ( left = st.st_size; left; left -= n ) { // exactly the length of the status
+		if ( (n = fread(buf, 1, (left < sizeof(buf)) ? left : sizeof(buf), fp)) == 0 ) {
+			memset(buf, 0, (n = (left < sizeof(buf)) ? left : sizeof(buf)));
+			}
+		ob_write(buf, n);
+		}
+	fclose(fp);
+	return true;
+	}
+
+// execute the commands of 'in'; returns the number of the failed commands
+int batch(FILE *in, bool nul) {
+	char	cmd[32], arg1[PATH_MAX], arg2[PATH_MAX], *e;
+	int		seq = 0, failed = 0;
+	list_node_t *node;
+	nwriter_t w;
+	note_t	*note;
+
+	dirwalk(""); // the index, updated by the commands
+	for ( ;; ) {
+		bt_eor = false;
+		if ( !bt_field(in, cmd, sizeof(cmd), nul) ) {
+			if ( feof(in) ) break;
+			continue; // empty line
+			}
+		seq ++;
+		if ( *cmd == '\0' ) { // an empty field with -0
+			bt_status(seq, nul, "error parse: empty command field");
+			failed ++;
+			ob_flush();
+			continue;
+			}
+		arg1[0] = arg2[0] = '\0';
+		bt_field(in, arg1, PATH_MAX, nul);
+		if ( strcmp(cmd, "add") == 0 || strcmp(cmd, "append") == 0 || strcmp(cmd, "move") == 0 )
+			bt_field(in, arg2, PATH_MAX, nul);
+		bt_skip(in, nul);
+
+		if ( strcmp(cmd, "add") == 0 || strcmp(cmd, "append") == 0 ) {
+			bool	append = (cmd[1] == 'p');
+			size_t	len = strtoul(arg1, &e, 10);
+			if ( *arg1 == '\0' || *e || *arg2 == '\0' ) {
+				bt_status(seq, nul, "error usage: %s LENGTH NAME", cmd);
+				failed ++;
+				break; // the stream is not synchronized anymore
+				}
+			if ( (note = make_note(arg2, "", 0x02)) == NULL ) {
+				bt_copy(in, -1, len);
+				bt_status(seq, nul, "error %s: %s", arg2, strerror(errno));
+				failed ++;
+				}
+			else {
+				bool exists = ( faccessat(section_fd(note->section), note_fname(note), F_OK, 0) == 0 );
+				if ( g_globber && exists != append ) {
+					bt_copy(in, -1, len);
+					bt_status(seq, nul, "error '%s' %s", arg2, (exists) ? "already exists" : "does not exist");
+					failed ++;
+					}
+				else if ( !nw_open(&w, note, append) ) {
+					bt_copy(in, -1, len);
+					bt_status(seq, nul, "error %s: %s", arg2, strerror(errno));
+					failed ++;
+					}
+				else {
+					bool ok = bt_copy(in, w.fd, len);
+					if ( nw_close(&w, ok) ) {
+						if ( !exists ) { // add to index
+							fstatat(section_fd(note->section), note_fname(note), &note->st, 0);
+							char *p = strrchr(note_fname(note), '.');
+							strcpy(note->ftype, (p) ? p + 1 : "");
+							if ( (p = strrchr(note->name, '.')) != NULL ) *p = '\0';
+							list_add(notes, note, sizeof(note_t));
+							if ( list_findstr(sections, note->section) == NULL )
+								list_addstr(sections, note->section);
+							}
+						bt_status(seq, nul, "ok");
+						}
+					else {
+						bt_status(seq, nul, "error %s: %s", arg2, strerror(errno));
+						failed ++;
+						}
+					}
+				m_free(note);
+				}
+			}
+		else if ( strcmp(cmd, "delete") == 0 || strcmp(cmd, "print") == 0 || strcmp(cmd, "move") == 0 ) {
+			if ( *arg1 == '\0' || (cmd[0] == 'm' && *arg2 == '\0') ) {
+				bt_status(seq, nul, "error usage: %s NAME%s", cmd, (cmd[0] == 'm') ? " NEW-NAME" : "");
+				failed ++;
+				}
+			else if ( (node = bt_find(arg1)) == NULL ) {
+				bt_status(seq, nul, "error '%s' not found", arg1);
+				failed ++;
+				}
+			else {
+				note = (note_t *) node->data;
+				bool ok = true;
+				if ( cmd[0] == 'd' ) {
+					if ( (ok = note_delete(note)) )
+						list_delete(notes, node);
+					}
+				else if ( cmd[0] == 'p' )
+					ok = bt_print(seq, note, nul);
+				else {
+					char	name[PATH_MAX];
+					if ( strrchr(arg2, '.') == NULL && *note->ftype ) // keeps its type, as -r
+						snprintf(name, PATH_MAX, "%s.%s", arg2, note->ftype);
+					else
+						strcpy(name, arg2);
+					note_t *nn = make_note(name, note->section, 0x02);
+					if ( nn && (ok = fio_renameat(section_fd(note->section), note_fname(note), section_fd(nn->section), note_fname(nn))) ) {
+						char *p;
+						strcpy(note->file, nn->file);
+						strcpy(note->section, nn->section);
+						strcpy(note->name, nn->name);
+						if ( (p = strrchr(note->name, '.')) != NULL ) *p = '\0';
+						p = strrchr(note_fname(note), '.');
+						strcpy(note->ftype, (p) ? p + 1 : "");
+						if ( list_findstr(sections, note->section) == NULL )
+							list_addstr(sections, note->section);
+						}
+					if ( nn )
+						m_free(nn);
+					else
+						ok = false;
+					}
+				if ( !ok ) {
+					bt_status(seq, nul, "error %s: %s", arg1, strerror(errno));
+					failed ++;
+					}
+				else if ( cmd[0] != 'p' )
+					bt_status(seq, nul, "ok");
+				}
+			}
+		else {
+			bt_status(seq, nul, "error unknown command '%s'", cmd);
+			failed ++;
+			}
+		ob_flush(); // the caller may wait for the status
+		}
+	ob_flush();
+	return failed;
+	}
+
+// === completion ===========================================================
+// the keys section/name of the notes in a prefix trie
+
+// build the trie of the keys of the notes
+trie_t *cpl_build() {
+	char	buf[PATH_MAX];
+	trie_t	*t = trie_create();
+	for ( list_node_t *cur = notes->head; cur; cur = cur->next )
+		trie_insert(t, note_key((note_t *) cur->data, buf));
+	return t;
+	}
+
+//
+void cpl_print(const char *key, void *arg) {
+	ob_puts(key);
+	ob_putc('\n');
+	}
+
+// === daemon ===============================================================
+// 'notes --daemon' keeps the notes in memory, current by inotify, and
+// answers the queries of the command-line instances on a UNIX socket.
+//
+// request:  "NOTES1" NUL ndir NUL conf NUL section NUL pattern NUL kind NUL
+// response: "OK" NUL, then 'S' section NUL for each section,
+//           'N' file NUL name NUL section NUL ftype NUL struct-stat per note,
+//           and 'E' at the end; anything else means "scan it yourself".
+//           for the kind 'C' (completion) the pattern is a prefix and the
+//           response is 'C' key NUL per key.
+// both sides check that the peer runs as the same user.
+
+#define DM_MAGIC	"NOTES1"
+static int	dm_ifd = -1;		// inotify
+static trie_t *dm_trie;			// completion keys
+static volatile sig_atomic_t dm_quit;
+
+// the path of the socket
+void dm_path(char *path) {
+	if ( getenv("XDG_RUNTIME_DIR") )
+		snprintf(path, sizeof(((struct sockaddr_un *) 0)->sun_path), "%s/notes.sock", getenv("XDG_RUNTIME_DIR"));
+	else
+		snprintf(path, sizeof(((struct sockaddr_un *) 0)->sun_path), "/tmp/notes-%d.sock", (int) getuid());
+	}
+
+// returns true if the other end of the socket runs as this user
+bool dm_peer(int fd) {
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+	}
+
+// connect to the daemon; returns the socket or -1
+int dm_connect() {
+	struct sockaddr_un addr;
+	int		fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	dm_path(addr.sun_path);
+	if ( (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 )
+		return -1;
+	if ( connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || !dm_peer(fd) ) {
+		close(fd);
+		return -1;
+		}
+	return fd;
+	}
+
+// write the whole buffer to the socket
+bool dm_send(int fd, const void *buf, size_t size) {
+	const char *p = (const char *) buf;
+	ssize_t	n;
+
+	while ( size ) {
+		if ( (n = send(fd, p, size, MSG_NOSIGNAL)) < 0 ) {
+			if ( errno == EINTR ) continue;
+			return false;
+			}
+		p += n;
+		size -= n;
+		}
+	return true;
+	}
+
+// dirwalk hook of the daemon; watch the directory
+void dm_watch(const char *rel, int fd) {
+	char	path[PATH_MAX];
+	snprintf(path, PATH_MAX, "%s/%s", ndir, rel);
+	inotify_add_watch(dm_ifd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+		| IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+	}
+
+// scan the notebook; the watches are replaced
+void dm_rescan() {
+	int old = dm_ifd;
+	dm_ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	list_clear(notes);
+	list_clear(sections);
+	dirwalk_dirhook = dm_watch;
+	dirwalk("");
+	dirwalk_dirhook = NULL;
+	if ( old >= 0 ) close(old);
+	trie_free(dm_trie);
+	dm_trie = cpl_build();
+	}
+
+// reload notesrc if it is changed or removed; the exclude patterns may be others
+bool dm_reload() {
+	char	sndir[PATH_MAX], sbdir[PATH_MAX];
+
+	if ( !conf_changed() && (conf_st.st_ino == 0 || access(conf, F_OK) == 0) )
+		return false;
+	strcpy(sndir, ndir);
+	strcpy(sbdir, bdir);
+	conf_free();
+	nc_clearkeys();
+	conf_defaults(true);
+	conf_load();
+	strcpy(ndir, sndir);
+	strcpy(bdir, sbdir);
+	return true;
+	}
+
+// returns true if there are changes since the last scan
+bool dm_changed() {
+	char	buf[0x4000] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool	changed = false;
+	while ( read(dm_ifd, buf, sizeof(buf)) > 0 )
+		changed = true;
+	return changed;
+	}
+
+// completion key to the response
+void dm_put_key(const char *key, void *arg) {
+	ob_putc('C');
+	ob_write(key, strlen(key) + 1);
+	}
+
+// answer a query; a client that does not send or read in time is dropped
+void dm_serve(int fd) {
+	char	req[PATH_MAX * 3], *f[6], *p;
+	struct timeval tv = { 2, 0 };
+	ssize_t	n, len = 0;
+	int		i;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	while ( len < sizeof(req) - 1 && (n = recv(fd, req + len, sizeof(req) - 1 - len, 0)) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			return;
+			}
+		len += n;
+		}
+	req[len] = '\0';
+	for ( i = 0, p = req; i < 6 && p < req + len; i ++, p += strlen(p) + 1 )
+		f[i] = p;
+	if ( i < 6 || strcmp(f[0], DM_MAGIC) != 0 || strcmp(f[1], ndir) != 0 || strcmp(f[2], conf) != 0 ) {
+		dm_send(fd, "NO", 3);
+		return;
+		}
+	bool reload = dm_reload();
+	if ( dm_changed() || reload )
+		dm_rescan();
+
+	// the results are written through the output buffer
+	dm_send(fd, "OK", 3);
+	if ( *f[5] == 'C' ) {
+		trie_complete(dm_trie, f[4], dm_put_key, NULL, 0);
+		ob_putc('E');
+		ob_flush();
+		return;
+		}
+	for ( list_node_t *cur = sections->head; cur; cur = cur->next ) {
+		const char *sec = (const char *) cur->data;
+		if ( *f[3] && strcmp(sec, f[3]) != 0 )
+			continue;
+		ob_putc('S');
+		ob_write(sec, strlen(sec) + 1);
+		}
+	for ( list_node_t *cur = notes->head; cur; cur = cur->next ) {
+		note_t *note = (note_t *) cur->data;
+		if ( *f[3] && strcmp(note->section, f[3]) != 0 )
+			continue;
+		if ( !note_match(note, f[4]) )
+			continue;
+		ob_putc('N');
+		ob_write(note->file, strlen(note->file) + 1);
+		ob_write(note->name, strlen(note->name) + 1);
+		ob_write(note->section, strlen(note->section) + 1);
+		ob_write(note->ftype, strlen(note->ftype) + 1);
+		ob_write((const char *) &note->st, sizeof(struct stat));
+		}
+	ob_putc('E');
+	ob_flush();
+	}
+
+//
+void dm_signal(int sig) {
+	dm_quit = 1;
+	}
+
+// the daemon; returns the exit code
+int dm_main() {
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct pollfd pfd[2];
+	int		lfd, cfd;
+
+	if ( (cfd = dm_connect()) >= 0 ) {
+		close(cfd);
+		fprintf(stderr, "notes: the daemon is already running.\n");
+		return EXIT_FAILURE;
+		}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	dm_path(addr.sun_path);
+	unlink(addr.sun_path); // stale
+	if ( (lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+			|| bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+			|| chmod(addr.sun_path, 0600) != 0
+			|| listen(lfd, 16) != 0 ) {
+		fprintf(stderr, "%s: errno %d: %s\n", addr.sun_path, errno, strerror(errno));
+		return EXIT_FAILURE;
+		}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = dm_signal;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	dm_rescan();
+	while ( !dm_quit ) {
+		pfd[0].fd = lfd;	pfd[0].events = POLLIN;
+		pfd[1].fd = dm_ifd;	pfd[1].events = POLLIN;
+		if ( poll(pfd, 2, -1) < 0 )
+			continue; // EINTR
+		if ( pfd[1].revents & POLLIN ) { // rescan when idle, not per event
+			if ( dm_changed() )
+				dm_rescan();
+			}
+		if ( pfd[0].revents & POLLIN ) {
+			if ( (cfd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0 && !dm_peer(cfd) ) {
+				close(cfd);
+				continue;
+				}
+			if ( cfd >= 0 ) {
+				int prev = ob_fd;
+				ob_fd = cfd;
+				dm_serve(cfd);
+				ob_fd = prev;
+				close(cfd);
+				}
+			}
+		}
+	close(lfd);
+	unlink(addr.sun_path);
+	if ( dm_ifd >= 0 ) close(dm_ifd);
+	dm_trie = trie_free(dm_trie);
+	return EXIT_SUCCESS;
+	}
+
+// send the request to the daemon; returns the complete response (free it
+// with m_free) and its size, or NULL if the daemon is not available
+char *dm_request(const char *section, const char *pattern, const char *kind, size_t *size) {
+	char	*buf;
+	size_t	len = 0, alloc = 0x10000;
+	ssize_t	n;
+	int		fd;
+
+	if ( (fd = dm_connect()) < 0 )
+		return NULL;
+	ob_flush();
+	int prev = ob_fd;
+	ob_fd = fd;
+	ob_write(DM_MAGIC, strlen(DM_MAGIC) + 1);
+	ob_write(ndir, strlen(ndir) + 1);
+	ob_write(conf, strlen(conf) + 1);
+	ob_write(section, strlen(section) + 1);
+	ob_write(pattern, strlen(pattern) + 1);
+	ob_write(kind, strlen(kind) + 1);
+	ob_flush();
+	ob_fd = prev;
+	shutdown(fd, SHUT_WR);
+
+	buf = (char *) m_alloc(alloc);
+	while ( (n = read(fd, buf + len, alloc - len)) != 0 ) {
+		if ( n < 0 ) {
+			if ( errno == EINTR ) continue;
+			break;
+			}
+		if ( (len += n) == alloc )
+			buf = (char *) m_realloc(buf, alloc *= 2);
+		}
+	close(fd);
+	if ( n != 0 || len < 4 || strcmp(buf, "OK") != 0 || buf[len - 1] != 'E' ) {
+		m_free(buf);
+		return NULL;
+		}
+	*size = len;
+	return buf;
+	}
+
+// copy the next field of the response to 'dst'; false if it is not
+// terminated before 'e' or it does not fit
+static bool dm_field(char **p, const char *e, char *dst, size_t size) {
+	size_t	n = strnlen(*p, e - *p);
+
+	if ( n == (size_t) (e - *p) || n >= size )
+		return false;
+	memcpy(dst, *p, n + 1);
+	*p += n + 1;
+	return true;
+	}
+
+// returns true if the section is a path under the notebook
+static bool dm_section(const char *sec) {
+	const char *p, *e;
+
+	if ( *sec == '\0' )
+		return true;
+	for ( p = sec; ; p = e + 1 ) {
+		e = p + strcspn(p, "/");
+		if ( e == p || (e - p == 1 && *p == '.') || (e - p == 2 && p[0] == '.' && p[1] == '.') )
+			return false;
+		if ( *e == '\0' )
+			return true;
+		}
+	}
+
+// read the next note of the response; false if it is malformed
+static bool dm_note(char **p, const char *e, note_t *note) {
+	char	file[PATH_MAX];
+
+	if ( !dm_field(p, e, note->file, PATH_MAX)
+			|| !dm_field(p, e, note->name, NAME_MAX)
+			|| !dm_field(p, e, note->section, NAME_MAX)
+			|| !dm_field(p, e, note->ftype, NAME_MAX)
+			|| (size_t) (e - *p) < sizeof(struct stat) )
+		return false;
+	if ( strchr(note->name, '/') || strchr(note->ftype, '/') || !dm_section(note->section) )
+		return false;
+	snprintf(file, PATH_MAX, "%s/%s%s%s%s%s", ndir, note->section, (*note->section) ? "/" : "",
+		note->name, (*note->ftype) ? "." : "", note->ftype);
+	if ( strcmp(file, note->file) != 0 )
+		return false;
+	memcpy(&note->st, *p, sizeof(struct stat));
+	*p += sizeof(struct stat);
+	return true;
+	}
+
+// parse the response; the notes and the sections are added if 'add',
+// otherwise it is only checked. returns false if it is malformed.
+static bool dm_parse(char *buf, size_t len, bool add) {
+	char	section[NAME_MAX], *p, *e;
+	note_t	note;
+
+	for ( p = buf + 3, e = buf + len - 1; p < e; ) {
+		if ( *p == 'S' ) {
+			p ++;
+			if ( !dm_field(&p, e, section, NAME_MAX) || !dm_section(section) )
+				return false;
+			if ( add && list_findstr(sections, section) == NULL )
+				list_addstr(sections, section);
+			}
+		else if ( *p == 'N' ) {
+			p ++;
+			if ( !dm_note(&p, e, &note) )
+				return false;
+			if ( add ) {
+				note_t *np = (note_t *) list_add(notes, &note, sizeof(note_t))->data;
+				if ( dirwalk_hook )
+					dirwalk_hook(np);
+				}
+			}
+		else
+			return false;
+		}
+	return true;
+	}
+
+// ask the daemon for the notes of the 'section' (or all) that match the 'pattern';
+// they are added as dirwalk() does. returns false if it is not available
+// or its answer is malformed.
+bool dm_query(const char *section, const char *pattern) {
+	char	*buf;
+	size_t	len;
+	bool	valid;
+
+	if ( (buf = dm_request(section, pattern, "Q", &len)) == NULL )
+		return false;
+	if ( (valid = dm_parse(buf, len, false)) ) // the answer is complete and sane, add the notes
+		dm_parse(buf, len, true);
+	m_free(buf);
+	return valid;
+	}
+
+// print the keys (section/name) that start with 'prefix'; by the daemon if it runs
+void complete(const char *prefix) {
+	char	*buf, *p;
+	size_t	len;
+	trie_t	*t;
+
+	if ( (buf = dm_request("", prefix, "C", &len)) != NULL ) {
+		for ( p = buf + 3; p < buf + len - 1 && *p == 'C' && memchr(p, '\0', buf + len - 1 - p); p += strlen(p) + 1 )
+			cpl_print(p + 1, NULL);
+		m_free(buf);
+		}
+	else {
+		dirwalk("");
+		t = cpl_build();
+		trie_complete(t, prefix, cpl_print, NULL, 0);
+		trie_free(t);
+		}
+	ob_flush();
+	}
+
 // main()
 int main(int argc, char *argv[]) {
 	int		i, j, exit_code = EXIT_FAILURE;
 	char	*asw = NULL;
+	list_t	*secs = list_create();
 	list_t	*args;
 	note_t	*note;
 	list_node_t *cur_arg = NULL;
-	bool	sectionf = false;
 	char	tmp[LINE_MAX];
 
 	setlocale(LC_ALL, "");
 
-	// custom rcfile
+	// custom rcfile and tracing, before the configuration
 	strcpy(conf, "");
 	for ( i = 1; i < argc; i ++ ) {
 		if ( strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--rcfile") == 0 ) {
 			if ( i < argc - 1 )
 				strcpy(conf, argv[i+1]);
 			}
+		else if ( strcmp(argv[i], "--trace") == 0 || strncmp(argv[i], "--trace=", 8) == 0 )
+			tr_start(argv[i] + ((argv[i][7]) ? 8 : 7));
 		}
+	tr_begin("main");
 	
 	//
+	int tr = tr_begin("init");
 	init();
+	tr_end(tr);
 	args = list_create();
 	for ( i = 1; i < argc; i ++ ) {
 		if ( argv[i][0] == '-' ) {
@@ -1837,10 +3734,11 @@ int main(int argc, char *argv[]) {
 				case 'v': opt_flags = OPT_VIEW; break;
 				case 'p': opt_flags = OPT_VIEW|OPT_PRINT; break;
 				case 'f': opt_flags |= OPT_FILES; break;
+				case '0': opt_out = OUT_NULL; if ( opt_flags & OPT_AUTO ) opt_flags = OPT_LIST; break;
 				case 'a': opt_flags = (opt_flags & OPT_AUTO) ? OPT_ADD : opt_flags | OPT_ALL; break;
 				case 'n': opt_flags = OPT_ADD | OPT_EDIT; break;
 				case '!': opt_flags |= OPT_NOCLOB; break;
-				case 's': asw = current_section; sectionf = true; break;
+				case 's': asw = current_section; break;
 				case 'r': opt_flags = OPT_MOVE; break;
 				case 'd': opt_flags = OPT_DEL; break;
 				case '+': opt_flags |= OPT_APPD; break;
@@ -1859,15 +3757,26 @@ int main(int argc, char *argv[]) {
 					else if ( strcmp(argv[i], "--print") == 0 )		{ opt_flags = OPT_VIEW|OPT_PRINT; }
 					else if ( strcmp(argv[i], "--edit") == 0 )		{ opt_flags = (opt_flags & OPT_AUTO) ? OPT_EDIT : opt_flags | OPT_EDIT; }
 					else if ( strcmp(argv[i], "--files") == 0 )		{ opt_flags |= OPT_FILES; }
+					else if ( strcmp(argv[i], "--null") == 0 )		{ opt_out = OUT_NULL; if ( opt_flags & OPT_AUTO ) opt_flags = OPT_LIST; }
+					else if ( strcmp(argv[i], "--json") == 0 )		{ opt_out = OUT_JSON; if ( opt_flags & OPT_AUTO ) opt_flags = OPT_LIST; }
 					else if ( strcmp(argv[i], "--delete") == 0 )	{ opt_flags = OPT_DEL; }
 					else if ( strcmp(argv[i], "--rename") == 0 )	{ opt_flags = OPT_MOVE; }
+					else if ( strcmp(argv[i], "--restore") == 0 )	{ opt_flags = OPT_RESTORE; }
+					else if ( strcmp(argv[i], "--daemon") == 0 )	{ opt_flags = OPT_DAEMON; }
+					else if ( strcmp(argv[i], "--batch") == 0 )		{ opt_flags = OPT_BATCH; }
 					else if ( strcmp(argv[i], "--complete") == 0 )	{ opt_flags = OPT_COMPL; }
-					else if ( strcmp(argv[i], "--section") == 0 )	{ asw = current_section; sectionf = true; }
+					else if ( strcmp(argv[i], "--section") == 0 )	{ asw = current_section; }
+					else if ( strcmp(argv[i], "--trace") == 0 || strncmp(argv[i], "--trace=", 8) == 0 )	{ }
 					else if ( strcmp(argv[i], "--help") == 0 )		{ puts(usage); return exit_code; }
 					else if ( strcmp(argv[i], "--version") == 0 )	{ puts(verss); return exit_code; }
-					else if ( strcmp(argv[i], "--onstart") == 0 )	{ if ( strlen(onstart_cmd) ) return system(onstart_cmd); }
-					else if ( strcmp(argv[i], "--onexit") == 0 )	{ if ( strlen(onexit_cmd) ) return system(onexit_cmd); }
-					return exit_code;
+					else if ( strcmp(argv[i], "--onstart") == 0 )	{ if ( onstart_sp ) return hook_run(onstart_sp); }
+					else if ( strcmp(argv[i], "--onexit") == 0 )	{ if ( onexit_sp ) return hook_run(onexit_sp); }
+					else {
+						fprintf(stderr, "unknown option [%s]\n", argv[i]);
+						return exit_code;
+						}
+					j = strlen(argv[i]) - 1; // we finished with this argv
+					break;
 				default:
 					fprintf(stderr, "unknown option [%c]\n", argv[i][j]);
 					return exit_code;
@@ -1877,6 +3786,8 @@ int main(int argc, char *argv[]) {
 		else {
 			if ( asw ) { // wait for string
 				strcpy(asw, argv[i]);
+				if ( asw == current_section ) // -s can be used many times
+					list_addstr(secs, argv[i]);
 				asw = NULL;
 				}
 			else 
@@ -1888,6 +3799,41 @@ int main(int argc, char *argv[]) {
 	if ( !g_globber )
 		opt_flags |= OPT_NOCLOB;
 
+	// command stream
+	if ( opt_flags & OPT_BATCH ) {
+		exit_code = ( batch(stdin, (opt_out == OUT_NULL)) == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+		args = list_destroy(args);
+		cleanup();
+		return exit_code;
+		}
+
+	// shell completion
+	if ( opt_flags & OPT_COMPL ) {
+		complete((args->head) ? (const char *) args->head->data : "");
+		args = list_destroy(args);
+		cleanup();
+		return EXIT_SUCCESS;
+		}
+
+	// resident index
+	if ( opt_flags & OPT_DAEMON ) {
+		exit_code = dm_main();
+		args = list_destroy(args);
+		cleanup();
+		return exit_code;
+		}
+
+	// restore deleted notes
+	if ( opt_flags & OPT_RESTORE ) {
+		if ( note_restore((args->head) ? (const char *) args->head->data : "*") )
+			exit_code = EXIT_SUCCESS;
+		else
+			fprintf(stderr, "* no notes restored *\n");
+		args = list_destroy(args);
+		cleanup();
+		return exit_code;
+		}
+
 	// no parameters
 	if ( args->head == NULL ) {
 		if ( opt_flags & OPT_LIST )
@@ -1911,7 +3857,8 @@ int main(int argc, char *argv[]) {
 		//
 		char	*name = (char *) cur_arg->data;
 		note_t	*note;
-		FILE	*fp;
+		nwriter_t w;
+		bool	ok;
 			
 		note = make_note(name, current_section, 0);
 		if ( !(opt_flags & OPT_NOCLOB ) ) {
@@ -1930,20 +3877,26 @@ int main(int argc, char *argv[]) {
 			}
 		
 		if ( note ) {
-			// create / truncate / open-for-append file
-			if ( (fp = fopen(note->file, ((opt_flags & OPT_APPD) ? "a" : "w"))) != NULL ) {
-				exit_code = EXIT_SUCCESS;
+			// new contents to temporary file, or open-for-append file
+			if ( nw_open(&w, note, (opt_flags & OPT_APPD)) ) {
+				ok = true;
 				cur_arg = cur_arg->next;
-				while ( cur_arg ) {
-					if ( print_file_to((const char *) cur_arg->data, fp) )
+				while ( ok && cur_arg ) {
+					if ( (ok = print_file_to((const char *) cur_arg->data, &w)) )
 						printf("* '%s' copied *\n", (const char *) cur_arg->data);
 					cur_arg = cur_arg->next;
 					}
-				if ( opt_flags & OPT_STDIN ) // the '-' option used
-					print_file_to(NULL, fp);
-				fclose(fp);
-				if ( opt_flags & OPT_EDIT )  // the '-e' option used
-					rule_exec('e', note->file);
+				if ( ok && (opt_flags & OPT_STDIN) ) // the '-' option used
+					ok = print_file_to(NULL, &w);
+				if ( !nw_close(&w, ok) ) {
+					if ( ok )
+						fprintf(stderr, "%s: errno %d: %s\n", note->file, errno, strerror(errno));
+					}
+				else {
+					exit_code = EXIT_SUCCESS;
+					if ( opt_flags & OPT_EDIT )  // the '-e' option used
+						rule_exec('e', note->file);
+					}
 				}
 			else
 				fprintf(stderr, "%s: errno %d: %s\n", note->file, errno, strerror(errno));
@@ -1957,31 +3910,34 @@ int main(int argc, char *argv[]) {
 		//	$1 is the note pattern, find note and do .. whatever
 		//	
 		
-		// create list of files
-		if ( sectionf ) {
-			char path[PATH_MAX];
-			snprintf(path, PATH_MAX, "%s/%s", ndir, current_section);
-			dirwalk(path);
+		// get list of notes according the patterns (argv) while walking;
+		// all the patterns and sections are matched in one scan
+		cli_pats = list_create();
+		cli_secs = secs;
+		do {
+			list_addstr(cli_pats, (const char *) cur_arg->data);
+			cur_arg = cur_arg->next;
+			} while ( cur_arg && !(opt_flags & OPT_MOVE) ); // -r pattern new-name
+		const char *scope = ( list_count(secs) == 1 ) ? (const char *) secs->head->data : "";
+		const char *pat = ( list_count(cli_pats) == 1 ) ? (const char *) cli_pats->head->data : "*";
+		list_t *res = cli_res = list_create(); // list of results
+		dirwalk_hook = cli_match;
+		int tr = tr_begin("scan");
+		if ( !cli_lookup() && !dm_query(scope, pat) ) {
+			int tw = tr_begin("dirwalk");
+			dirwalk(scope);
+			tr_end(tw);
 			}
-		else
-			dirwalk(ndir);
-
-		// get list of notes according the pattern (argv)
-		const char *note_pat = (const char *) cur_arg->data;
-		cur_arg = cur_arg->next;
-		list_t *res = list_create(); // list of results
-		for ( list_node_t *np = notes->head; np; np = np->next ) {
-			note = (note_t *) np->data;
-			if ( sectionf ) {
-				if ( strcmp(current_section, note->section) != 0 )
-					continue;
-				}
-			if ( fnmatch(note_pat, note->name, FNM_PERIOD | FNM_CASEFOLD | FNM_GLIBC_EXTRA) == 0 ) {
-				if ( (opt_flags & OPT_LIST) || (opt_flags & OPT_AUTO) || (opt_flags & OPT_FILES) )
-					note_pl(note);
-				list_addptr(res, note);
-				}
+		tr_end(tr);
+		dirwalk_hook = NULL;
+
+		// the column of sections is known only after the scan
+		if ( cli_listing() && !cli_streaming() ) {
+			size_t seclen = sections_maxlen();
+			for ( list_node_t *np = res->head; np; np = np->next )
+				note_pl((note_t *) np->data, seclen);
 			}
+		ob_flush();
 
 		//
 		//	'res' has the collected files, now do whatever with them
@@ -1989,6 +3945,8 @@ int main(int argc, char *argv[]) {
 		size_t res_count = list_count(res);
 		if ( !(opt_flags & OPT_FILES) && res_count ) {
 			list_node_t *cur = res->head;
+			const char **batch = NULL;	// --all, the files for the rules
+			int		batch_count = 0;
 			
 			exit_code = EXIT_SUCCESS;
 			if ( (opt_flags == OPT_AUTO) && res_count == 1 )
@@ -2005,6 +3963,11 @@ int main(int argc, char *argv[]) {
 						}
 					if ( opt_flags & OPT_PRINT )
 						note_print(note);
+					else if ( opt_flags & OPT_ALL ) { // one process per rule, after the loop
+						if ( !batch )
+							batch = (const char **) m_alloc(sizeof(char *) * res_count);
+						batch[batch_count ++] = note->file;
+						}
 					else 
 						rule_exec(action, note->file);
 					if ( (opt_flags & OPT_ALL) == 0 )
@@ -2022,20 +3985,17 @@ int main(int argc, char *argv[]) {
 					else {
 						char	new_file[PATH_MAX], *p, *ext;
 						char	*arg = (char *) cur_arg->data;
-						size_t	root_dir_len = strlen(ndir) + 1;
 						
 						if ( (ext = strrchr(note->file, '.')) == NULL )
 							ext = default_ftype;
 						else 
 							ext ++;
-						strcpy(new_file, note->file);
-						new_file[root_dir_len] = '\0';
-						strcat(new_file, arg);
+						strcpy(new_file, arg); // relative to ndir
 						if ( (p = strrchr(arg, '.')) == NULL ) {
 							strcat(new_file, ".");
 							strcat(new_file, ext);
 							}
-						if ( rename(note->file, new_file) == 0 )
+						if ( renameat(section_fd(note->section), note_fname(note), ndir_fd, new_file) == 0 )
 							printf("* '%s' -> '%s' succeed *\n", note->name, arg);
 						else
 							fprintf(stderr, "rename failed:\n[%s] -> [%s]\nerrno %d: %s\n",
@@ -2047,6 +4007,10 @@ int main(int argc, char *argv[]) {
 				// next note
 				cur = cur->next;
 				}
+			if ( batch ) {
+				rule_exec_list((opt_flags & OPT_EDIT) ? 'e' : 'v', batch, batch_count);
+				m_free(batch);
+				}
 			}
 		else {
 			if ( !(opt_flags & OPT_FILES) )
@@ -2054,10 +4018,12 @@ int main(int argc, char *argv[]) {
 			}
 		
 		res = list_destroy(res);
+		cli_pats = list_destroy(cli_pats);
 		}
 
 	// finish
 	args = list_destroy(args);
+	secs = list_destroy(secs);
 	cleanup();
 	return exit_code;
 	}
@@ -0,0 +1,261 @@
+/*
+ *	process launcher
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "errio.h"
+#include "spawn.h"
+#include "trace.h"
+
+extern char **environ;
+
+// characters that only the shell can handle
+#define SP_SHELLCH	"|&;<>()$`\\\"'*?[]{}~#\n"
+
+static char sp_files[] = "%f";	// the argv entry of the list of files
+
+#define SP_STRMAX	0x20000		// max length of one argument or variable (MAX_ARG_STRLEN)
+#define SP_HEADROOM	0x800		// as xargs
+
+struct sp_cmd_s {
+	char	*line;		// the command line
+	char	**argv;		// words or NULL if it needs the shell
+	int		argc;
+	};
+
+// parse the command line 'line'
+sp_cmd_t *sp_parse(const char *line) {
+	sp_cmd_t *cmd = (sp_cmd_t *) m_alloc(sizeof(sp_cmd_t));
+	char	*buf, *p, *s, *d;
+	int		n;
+
+	while ( isblank(*line) ) line ++;
+	cmd->line = strdup(line);
+	cmd->argv = NULL;
+	cmd->argc = 0;
+	if ( strpbrk(line, SP_SHELLCH) )
+		return cmd;
+
+	// split words
+	buf = strdup(line);
+	cmd->argv = (char **) m_alloc(sizeof(char *) * (strlen(line) / 2 + 2));
+	for ( p = strtok(buf, " \t\r"); p; p = strtok(NULL, " \t\r") ) {
+		if ( cmd->argc == 0 && strchr(p, '=') ) // variable assignment
+			break;
+		if ( strcmp(p, "%f") == 0 ) {
+			cmd->argv[cmd->argc ++] = sp_files;
+			continue;
+			}
+		for ( s = d = p; *s; ) {
+			if ( s[0] == '%' && s[1] == '%' ) { *d ++ = '%'; s += 2; continue; }
+			if ( s[0] == '%' && s[1] == 'f' ) break; // part of a word
+			*d ++ = *s ++;
+			}
+		if ( *s )
+			break;
+		*d = '\0';
+		cmd->argv[cmd->argc ++] = strdup(p);
+		}
+	if ( p || cmd->argc == 0 ) { // needs the shell
+		for ( n = 0; n < cmd->argc; n ++ )
+			if ( cmd->argv[n] != sp_files ) free(cmd->argv[n]);
+		m_free(cmd->argv);
+		cmd->argv = NULL;
+		cmd->argc = 0;
+		}
+	else
+		cmd->argv[cmd->argc] = NULL;
+	free(buf);
+	return cmd;
+	}
+
+// free the command
+sp_cmd_t *sp_free(sp_cmd_t *cmd) {
+	if ( cmd ) {
+		if ( cmd->argv ) {
+			for ( int i = 0; i < cmd->argc; i ++ )
+				if ( cmd->argv[i] != sp_files ) free(cmd->argv[i]);
+			m_free(cmd->argv);
+			}
+		free(cmd->line);
+		m_free(cmd);
+		}
+	return NULL;
+	}
+
+// returns true if the command needs the shell
+bool sp_isshell(const sp_cmd_t *cmd) {
+	return (cmd->argv == NULL);
+	}
+
+// returns the files quoted for the shell
+char *sp_quote(const char **files, int count) {
+	size_t	len = 1;
+	char	*buf, *d;
+	const char *s;
+
+	for ( int i = 0; i < count; i ++ )
+		len += strlen(files[i]) * 4 + 3;
+	d = buf = (char *) m_alloc(len);
+	for ( int i = 0; i < count; i ++ ) {
+		if ( i ) *d ++ = ' ';
+		*d ++ = '\'';
+		for ( s = files[i]; *s; s ++ ) {
+			if ( *s == '\'' ) { strcpy(d, "'\\''"); d += 4; }
+			else *d ++ = *s;
+			}
+		*d ++ = '\'';
+		}
+	*d = '\0';
+	return buf;
+	}
+
+// quoted length of the file
+static size_t sp_qlen(const char *file) {
+	size_t	len = 3;	// quotes and separator
+	for ( ; *file; file ++ )
+		len += ( *file == '\'' ) ? 4 : 1;
+	return len;
+	}
+
+// returns the number of the files that fit in one execution (at least one)
+int sp_chunk(const sp_cmd_t *cmd, const char **files, int count, const char *envvar) {
+	long	argmax = sysconf(_SC_ARG_MAX);
+	size_t	used = SP_HEADROOM, qlen = strlen(cmd->line), cost;
+	size_t	vlen = (envvar) ? strlen(envvar) + 1 : 0;
+	int		n;
+
+	if ( argmax <= 0 || argmax > 0x400000 )
+		argmax = 0x400000;
+	for ( char **e = environ; *e; e ++ ) {
+		if ( vlen && strncmp(*e, envvar, vlen - 1) == 0 && (*e)[vlen - 1] == '=' )
+			continue; // it will be replaced
+		used += strlen(*e) + 1 + sizeof(char *);
+		}
+	used += qlen + 16 + vlen;
+	for ( n = 0; n < count; n ++ ) {
+		size_t q = sp_qlen(files[n]);
+		cost = q;						// the quoted list in the environment
+		if ( cmd->argv )
+			cost += strlen(files[n]) + 1 + sizeof(char *);
+		else
+			cost += q;					// the quoted list in the command line
+		if ( n && (used + cost > (size_t) argmax || qlen + q > SP_STRMAX) )
+			break;
+		used += cost;
+		qlen += q;
+		}
+	return ( n ) ? n : 1;
+	}
+
+// execute argv[0] and wait; the interrupts go to the child, as system(3)
+int sp_spawn(char *const argv[]) {
+	posix_spawnattr_t attr;
+	struct sigaction sa, sint, squit;
+	sigset_t	mask;
+	pid_t		pid;
+	int			status = -1, e;
+
+	sa.sa_handler = SIG_IGN;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, &sint);
+	sigaction(SIGQUIT, &sa, &squit);
+
+	posix_spawnattr_init(&attr);
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	posix_spawnattr_setsigdefault(&attr, &mask);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	if ( (e = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ)) == 0 ) {
+		tr_count(TR_SPAWN, 1);
+		while ( waitpid(pid, &status, 0) < 0 ) {
+			if ( errno != EINTR ) { status = -1; break; }
+			}
+		}
+	else {
+		fprintf(stderr, "%s: %s\n", argv[0], strerror(e));
+		status = 127 << 8; // as the shell does
+		}
+	posix_spawnattr_destroy(&attr);
+
+	sigaction(SIGINT, &sint, NULL);
+	sigaction(SIGQUIT, &squit, NULL);
+	return status;
+	}
+
+// execute the command with 'files' and wait
+int sp_run(const sp_cmd_t *cmd, const char **files, int count) {
+	char	**argv, *line, *d, *qf;
+	const char *p;
+	bool	sq = false;
+	int		rv, n = 0, i, j;
+
+	if ( cmd->argv ) { // direct
+		for ( i = 0; i < cmd->argc; i ++ )
+			if ( cmd->argv[i] == sp_files ) n ++;
+		argv = (char **) m_alloc(sizeof(char *) * (cmd->argc + n * count + 1));
+		for ( i = j = 0; i < cmd->argc; i ++ ) {
+			if ( cmd->argv[i] == sp_files ) {
+				for ( int k = 0; k < count; k ++ )
+					argv[j ++] = (char *) files[k];
+				}
+			else
+				argv[j ++] = cmd->argv[i];
+			}
+		argv[j] = NULL;
+		rv = ( j ) ? sp_spawn(argv) : 0;
+		m_free(argv);
+		return rv;
+		}
+
+	// shell, expand the %f outside of single quotes
+	qf = sp_quote(files, count);
+	for ( p = cmd->line; (p = strstr(p, "%f")) != NULL; p += 2 )
+		n ++;
+	d = line = (char *) m_alloc(strlen(cmd->line) + n * strlen(qf) + 1);
+	for ( p = cmd->line; *p; ) {
+		if ( *p == '\'' )
+			sq = !sq;
+		else if ( !sq && *p == '%' ) {
+			if ( p[1] == '%' ) { *d ++ = '%'; p += 2; continue; }
+			if ( p[1] == 'f' ) { strcpy(d, qf); d += strlen(qf); p += 2; continue; }
+			}
+		*d ++ = *p ++;
+		}
+	*d = '\0';
+	char *argv_sh[] = { "/bin/sh", "-c", line, NULL };
+	rv = sp_spawn(argv_sh);
+	m_free(line);
+	m_free(qf);
+	return rv;
+	}
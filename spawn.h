@@ -0,0 +1,65 @@
+/*
+ *	process launcher
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+
+#if !defined(__SPAWN_H__)
+#define __SPAWN_H__
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// a parsed command line; '%f' is the list of files and '%%' is the '%'.
+// commands without shell syntax are executed directly (posix_spawnp),
+// the rest by '/bin/sh -c'.
+typedef struct sp_cmd_s sp_cmd_t;
+
+// parse the command line 'line'
+sp_cmd_t *sp_parse(const char *line);
+
+// free the command; returns NULL
+sp_cmd_t *sp_free(sp_cmd_t *cmd);
+
+// returns true if the command needs the shell
+bool sp_isshell(const sp_cmd_t *cmd);
+
+// returns the files quoted for the shell ('a' 'b' ...); free it with m_free
+char *sp_quote(const char **files, int count);
+
+// execute the command with 'files' for the '%f' and wait;
+// returns the status of the child as system(3) does.
+int sp_run(const sp_cmd_t *cmd, const char **files, int count);
+
+// returns how many of the 'files' fit in one execution of the command,
+// as xargs does; the list is also counted as the value of the environment
+// variable 'envvar' (or NULL), that the caller sets, replacing the current.
+int sp_chunk(const sp_cmd_t *cmd, const char **files, int count, const char *envvar);
+
+// execute argv[0] with argv and wait; returns the status of the child.
+int sp_spawn(char *const argv[]);
+
+#if defined(__cplusplus)
+	}
+#endif
+
+#endif
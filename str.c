@@ -125,6 +125,10 @@ size_t	u8strlen(const char *str) {
 
 // width in screen-columns of wcs
 size_t u8width(const char *str) {
+	const unsigned char *a = (const unsigned char *) str;
+	while ( *a && *a < 0x80 ) a ++;
+	if ( *a == '\0' ) // ascii, one column per byte
+		return a - (const unsigned char *) str;
 	wchar_t *s = u8towcs(str);
 	int	n = wcswidth(s, wcslen(s));
 	m_free(s);
@@ -392,31 +396,61 @@ int res_replace(const char *pattern, char *source, const char *repl, size_t max_
 
 // converts a text to text-lines table
 char	**text_to_lines(const char *src) {
-	char	*str = strdup(src), *p, *ps;
+	const char *p, *ps;
 	char	**table;
-	int		lines, len, pos;
+	int		lines, pos;
 
-	len = strlen(str);
-	if ( len && str[len-1] != '\n' ) {
-		str[len] = '\n';
-		str[++ len] = '\0';
-		}
-	for ( p = str, lines = 0; *p; p ++ )
+	for ( p = src, lines = 0; *p; p ++ )
 		if ( *p == '\n' ) lines ++;
+	if ( p > src && p[-1] != '\n' )
+		lines ++;
 	table = (char **) m_alloc(sizeof(char*) * (lines + 1));
 	table[lines] = NULL;
-	pos = 0;
-	for ( ps = p = str; *p; p ++ ) {
-		if ( *p == '\n' ) {
-			*p = '\0';
-			table[pos ++] = strdup(ps);
+	for ( pos = 0, ps = p = src; pos < lines; p ++ ) {
+		if ( *p == '\n' || *p == '\0' ) {
+			table[pos ++] = strndup(ps, p - ps);
 			ps = p + 1;
 			}
 		}
-	m_free(str);
 	return table;
 	}
 
+// splits a text to lines; the lines are slices of one copy of the text
+textspan_t *text_to_spans(const char *src) {
+	textspan_t *t = (textspan_t *) m_alloc(sizeof(textspan_t));
+	const char *p;
+	size_t	len = strlen(src);
+	int		lines, pos;
+
+	t->text = (char *) m_alloc(len + 1);
+	memcpy(t->text, src, len + 1);
+	for ( p = t->text, lines = 0; *p; p ++ )
+		if ( *p == '\n' ) lines ++;
+	if ( len && t->text[len-1] != '\n' )
+		lines ++;
+	t->line = (strspan_t *) m_alloc(sizeof(strspan_t) * (lines + 1));
+	t->count = lines;
+	for ( pos = 0, p = t->text; pos < lines; pos ++ ) {
+		const char *e = strchr(p, '\n');
+		if ( e == NULL )
+			e = p + strlen(p);
+		t->line[pos].ptr = p;
+		t->line[pos].len = e - p;
+		p = e + 1;
+		}
+	return t;
+	}
+
+// frees the text-lines created by text_to_spans, returns always NULL
+textspan_t *free_text_spans(textspan_t *t) {
+	if ( t ) {
+		m_free(t->line);
+		m_free(t->text);
+		m_free(t);
+		}
+	return NULL;
+	}
+
 // m_frees a text-lines table
 char **free_text_lines(char **table) {
 	for ( int i = 0; table[i]; i ++ )
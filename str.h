@@ -35,6 +35,20 @@ extern "C" {
 #include <regex.h>
 #include <stdbool.h>
 
+/*
+ *	text lines as slices of one buffer
+ */
+typedef struct {
+	const char *ptr;	// begin of line, not terminated
+	size_t	len;		// length in bytes, without the new-line
+	} strspan_t;
+
+typedef struct {
+	char	*text;		// the copy of the text
+	strspan_t *line;	// table of lines
+	int		count;		// number of lines
+	} textspan_t;
+
 /*
  *	constant words list
  */
@@ -96,6 +110,8 @@ const char *parse_const(const char *src, const char *str);
 // utilities
 char **text_to_lines(const char *src);
 char **free_text_lines(char **table);
+textspan_t *text_to_spans(const char *src);
+textspan_t *free_text_spans(textspan_t *t);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,317 @@
+/*
+ *	phase timers and counters
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "errio.h"
+#include "trace.h"
+
+#define TR_DEPTH	16		// max nesting
+#define TR_EVENTS	65536	// kept for the JSON output, the rest are only summed
+#define TR_HISTS	8		// histograms in the report
+
+unsigned long tr_counter[TR_NCOUNT];
+static const char *tr_names[TR_NCOUNT] = { "files", "stat", "fnmatch", "read", "spawn" };
+
+// a completed phase
+typedef struct {
+	const char *name;
+	int		depth, sum;				// its summary
+	long long start, dur;			// ns
+	unsigned long count[TR_NCOUNT];	// counted in the phase
+	} tr_event_t;
+
+// the summary of a phase by name and depth, in order of first begin
+typedef struct {
+	const char *name;
+	int		depth, calls;
+	long long total, max;
+	unsigned long count[TR_NCOUNT];
+	} tr_sum_t;
+
+static bool		tr_on;
+static char		*tr_file;
+static long long tr_t0;
+static tr_event_t tr_stack[TR_DEPTH];
+static int		tr_depth;
+static tr_event_t *tr_events;
+static int		tr_nevents, tr_dropped;
+static tr_sum_t	*tr_sums;
+static int		tr_nsums, tr_asums;
+static struct { const char *name; const tr_hist_t *h; } tr_hists[TR_HISTS];
+static int		tr_nhists;
+
+// monotonic clock in ns
+long long tr_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	}
+
+//
+void tr_start(const char *file) {
+	if ( !tr_on )
+		atexit(tr_finish);
+	tr_on = true;
+	tr_file = ( file && *file ) ? strdup(file) : NULL;
+	tr_t0 = tr_now();
+	}
+
+// returns the summary of the phase, creates it if new
+static int tr_sum(const char *name, int depth) {
+	tr_sum_t *s;
+	int		i;
+
+	for ( i = 0; i < tr_nsums; i ++ )
+		if ( tr_sums[i].depth == depth && strcmp(tr_sums[i].name, name) == 0 )
+			return i;
+	if ( tr_nsums == tr_asums ) {
+		tr_asums = ( tr_asums ) ? tr_asums * 2 : 32;
+		tr_sums = (tr_sum_t *) m_realloc(tr_sums, sizeof(tr_sum_t) * tr_asums);
+		}
+	s = &tr_sums[tr_nsums];
+	memset(s, 0, sizeof(tr_sum_t));
+	s->name = name;
+	s->depth = depth;
+	return tr_nsums ++;
+	}
+
+//
+int tr_begin(const char *name) {
+	tr_event_t *e;
+
+	if ( !tr_on || tr_depth == TR_DEPTH )
+		return -1;
+	e = &tr_stack[tr_depth];
+	e->name = name;
+	e->depth = tr_depth;
+	e->sum = tr_sum(name, tr_depth);
+	memcpy(e->count, tr_counter, sizeof(tr_counter));
+	e->start = tr_now();
+	return tr_depth ++;
+	}
+
+// the phase 'id' ends, and the phases opened in it
+void tr_end(int id) {
+	tr_event_t *e;
+	tr_sum_t *s;
+	long long now;
+
+	if ( id < 0 || id >= tr_depth )
+		return;
+	now = tr_now();
+	while ( tr_depth > id ) {
+		e = &tr_stack[-- tr_depth];
+		e->dur = now - e->start;
+		for ( int i = 0; i < TR_NCOUNT; i ++ )
+			e->count[i] = tr_counter[i] - e->count[i];
+		s = &tr_sums[e->sum];
+		s->calls ++;
+		s->total += e->dur;
+		if ( e->dur > s->max )
+			s->max = e->dur;
+		for ( int i = 0; i < TR_NCOUNT; i ++ )
+			s->count[i] += e->count[i];
+		if ( tr_nevents < TR_EVENTS ) {
+			if ( !tr_events )
+				tr_events = (tr_event_t *) m_alloc(sizeof(tr_event_t) * TR_EVENTS);
+			tr_events[tr_nevents ++] = *e;
+			}
+		else
+			tr_dropped ++;
+		}
+	}
+
+// === histograms ===
+
+// the bucket of the value
+static int tr_hbucket(long long v) {
+	int		e;
+
+	if ( v < TR_HSUB )
+		return ( v < 0 ) ? 0 : (int) v;
+	e = 63 - __builtin_clzll((unsigned long long) v);	// 2^e <= v, e >= 4
+	return (e - 3) * TR_HSUB + (int) ((v >> (e - 4)) & (TR_HSUB - 1));
+	}
+
+// the lowest value of the bucket
+static long long tr_hvalue(int b) {
+	if ( b < TR_HSUB )
+		return b;
+	return (long long) (TR_HSUB + b % TR_HSUB) << (b / TR_HSUB - 1);
+	}
+
+//
+void tr_hist_add(tr_hist_t *h, long long ns) {
+	int		b = tr_hbucket(ns);
+
+	if ( b >= TR_HBUCKETS )
+		b = TR_HBUCKETS - 1;
+	h->count[b] ++;
+	if ( h->n == 0 || ns < h->min ) h->min = ns;
+	if ( ns > h->max ) h->max = ns;
+	h->sum += ns;
+	h->n ++;
+	}
+
+// the value at the percentile; the middle of its bucket, within min and max
+long long tr_hist_pct(const tr_hist_t *h, double pct) {
+	unsigned long rank, acc = 0;
+	long long v;
+
+	if ( h->n == 0 )
+		return 0;
+	rank = (unsigned long) (pct / 100.0 * h->n + 0.5);
+	if ( rank < 1 ) rank = 1;
+	for ( int b = 0; b < TR_HBUCKETS; b ++ ) {
+		if ( (acc += h->count[b]) >= rank ) {
+			v = (tr_hvalue(b) + tr_hvalue(b + 1)) / 2;
+			if ( v < h->min ) v = h->min;
+			if ( v > h->max ) v = h->max;
+			return v;
+			}
+		}
+	return h->max;
+	}
+
+//
+char *tr_hist_print(const tr_hist_t *h, const char *name, bool dist, char *buf, size_t size) {
+	static const double pcts[] = { 50, 90, 99, 99.9 };
+	size_t	len;
+
+	if ( !h ) {
+		snprintf(buf, size, "%-8s %7s %8s %8s %8s %8s %8s %8s %8s\n",
+			"(ms)", "n", "min", "mean", "p50", "p90", "p99", "p99.9", "max");
+		return buf;
+		}
+	len = snprintf(buf, size, "%-8s %7lu %8.3f %8.3f", name, h->n, h->min / 1e6, (h->n) ? h->sum / 1e6 / h->n : 0.0);
+	for ( int i = 0; i < 4 && len < size; i ++ )
+		len += snprintf(buf + len, size - len, " %8.3f", tr_hist_pct(h, pcts[i]) / 1e6);
+	if ( len < size )
+		len += snprintf(buf + len, size - len, " %8.3f\n", h->max / 1e6);
+	for ( int b = 0; dist && b < TR_HBUCKETS && len < size; b ++ ) {
+		if ( h->count[b] == 0 )
+			continue;
+		int bar = (int) (h->count[b] * 40 / h->n);
+		len += snprintf(buf + len, size - len, "  %9.3f - %9.3f %8lu %.*s\n",
+			tr_hvalue(b) / 1e6, tr_hvalue(b + 1) / 1e6, h->count[b],
+			( bar ) ? bar : 1, "########################################");
+		}
+	return buf;
+	}
+
+//
+void tr_hist_report(const char *name, const tr_hist_t *h) {
+	if ( tr_nhists < TR_HISTS ) {
+		tr_hists[tr_nhists].name = name;
+		tr_hists[tr_nhists ++].h = h;
+		}
+	}
+
+// === report ===
+
+// text report
+static void tr_text(FILE *fp) {
+	char	buf[8192];
+
+	fprintf(fp, "%-28s %7s %11s %11s", "phase", "calls", "total ms", "max ms");
+	for ( int j = 0; j < TR_NCOUNT; j ++ )
+		fprintf(fp, " %9s", tr_names[j]);
+	fprintf(fp, "\n");
+	for ( int i = 0; i < tr_nsums; i ++ ) {
+		tr_sum_t *s = &tr_sums[i];
+		fprintf(fp, "%*s%-*s %7d %11.3f %11.3f", s->depth * 2, "", 28 - s->depth * 2, s->name,
+			s->calls, s->total / 1e6, s->max / 1e6);
+		for ( int j = 0; j < TR_NCOUNT; j ++ )
+			fprintf(fp, " %9lu", s->count[j]);
+		fprintf(fp, "\n");
+		}
+	fprintf(fp, "%-28s %7s %11.3f %11s", "(process)", "", (tr_now() - tr_t0) / 1e6, "");
+	for ( int j = 0; j < TR_NCOUNT; j ++ )
+		fprintf(fp, " %9lu", tr_counter[j]);
+	fprintf(fp, "\n");
+	if ( tr_dropped )
+		fprintf(fp, "(%d events not kept)\n", tr_dropped);
+	for ( int i = 0; i < tr_nhists; i ++ ) {
+		if ( i == 0 )
+			fprintf(fp, "\n%s", tr_hist_print(NULL, NULL, false, buf, sizeof(buf)));
+		fputs(tr_hist_print(tr_hists[i].h, tr_hists[i].name, (i == 0), buf, sizeof(buf)), fp);
+		}
+	}
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto)
+static void tr_json(FILE *fp) {
+	int		pid = (int) getpid();
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for ( int i = 0; i < tr_nevents; i ++ ) {
+		tr_event_t *e = &tr_events[i];
+		fprintf(fp, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+			e->name, pid, pid, (e->start - tr_t0) / 1e3, e->dur / 1e3);
+		for ( int j = 0; j < TR_NCOUNT; j ++ )
+			fprintf(fp, "%s\"%s\":%lu", (j) ? "," : "", tr_names[j], e->count[j]);
+		fprintf(fp, "}},\n");
+		}
+	fprintf(fp, "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":%d,\"ts\":%.3f,\"args\":{", pid, (tr_now() - tr_t0) / 1e3);
+	for ( int j = 0; j < TR_NCOUNT; j ++ )
+		fprintf(fp, "%s\"%s\":%lu", (j) ? "," : "", tr_names[j], tr_counter[j]);
+	fprintf(fp, "}}\n],\"displayTimeUnit\":\"ms\",\"otherData\":{");
+	for ( int i = 0; i < tr_nhists; i ++ ) { // the histograms as percentiles in ms
+		const tr_hist_t *h = tr_hists[i].h;
+		fprintf(fp, "%s\"%s\":{\"n\":%lu,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p99.9\":%.3f,\"max\":%.3f}",
+			(i) ? "," : "", tr_hists[i].name, h->n, h->min / 1e6, tr_hist_pct(h, 50) / 1e6, tr_hist_pct(h, 90) / 1e6,
+			tr_hist_pct(h, 99) / 1e6, tr_hist_pct(h, 99.9) / 1e6, h->max / 1e6);
+		}
+	fprintf(fp, "}}\n");
+	}
+
+//
+void tr_finish() {
+	FILE	*fp = stderr;
+	size_t	len;
+
+	if ( !tr_on )
+		return;
+	tr_end(0);
+	if ( tr_file && (fp = fopen(tr_file, "w")) == NULL ) {
+		fprintf(stderr, "trace: %s: cannot write\n", tr_file);
+		fp = stderr;
+		}
+	len = ( tr_file ) ? strlen(tr_file) : 0;
+	if ( fp != stderr && len > 5 && strcmp(tr_file + len - 5, ".json") == 0 )
+		tr_json(fp);
+	else
+		tr_text(fp);
+	if ( fp != stderr )
+		fclose(fp);
+	if ( tr_events ) m_free(tr_events);
+	if ( tr_sums ) m_free(tr_sums);
+	if ( tr_file ) free(tr_file);
+	tr_events = NULL;
+	tr_sums = NULL;
+	tr_file = NULL;
+	tr_nevents = tr_nsums = tr_asums = tr_dropped = tr_nhists = 0;
+	tr_on = false;
+	}
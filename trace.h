@@ -0,0 +1,74 @@
+/*
+ *	phase timers and counters
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+#if !defined(__TRACE_H__)
+#define __TRACE_H__
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// counters; they are always counted, the cost is an addition
+enum { TR_FILES, TR_STAT, TR_FNMATCH, TR_READ, TR_SPAWN, TR_NCOUNT };
+extern unsigned long tr_counter[TR_NCOUNT];
+#define tr_count(c, n)	(tr_counter[(c)] += (n))
+
+// enable the tracing; the report goes to 'file' or to stderr if NULL,
+// as Chrome trace-event JSON if the 'file' ends with ".json", at exit
+void tr_start(const char *file);
+
+// a phase; tr_begin returns the handle for tr_end, phases can be nested
+int  tr_begin(const char *name);
+void tr_end(int id);
+
+// ends the open phases and writes the report
+void tr_finish();
+
+// monotonic clock in ns
+long long tr_now();
+
+// log-linear histogram of durations in ns; 16 sub-buckets per power of two,
+// so a value is kept with ~6% precision at any magnitude.
+#define TR_HSUB		16
+#define TR_HBUCKETS	(61 * TR_HSUB)
+typedef struct {
+	unsigned long count[TR_HBUCKETS];
+	unsigned long n;
+	long long min, max, sum;
+	} tr_hist_t;
+
+void tr_hist_add(tr_hist_t *h, long long ns);
+long long tr_hist_pct(const tr_hist_t *h, double pct);
+
+// writes the summary line of the histogram (ms) to 'buf', or the header
+// if 'h' is NULL; with 'dist' also the populated buckets. returns 'buf'.
+char *tr_hist_print(const tr_hist_t *h, const char *name, bool dist, char *buf, size_t size);
+
+// the histogram is added to the report at exit
+void tr_hist_report(const char *name, const tr_hist_t *h);
+
+#if defined(__cplusplus)
+	}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ *	compressed prefix trie
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "errio.h"
+#include "trie.h"
+
+typedef struct trie_node_s {
+	char	*label;					// the part of the key of the edge to this node
+	size_t	len;
+	bool	term;					// a key ends here
+	int		count, alloc;
+	struct trie_node_s **child;		// sorted by label[0]
+	} trie_node_t;
+
+struct trie_s {
+	trie_node_t root;
+	};
+
+//
+static trie_node_t *trie_node(const char *label, size_t len) {
+	trie_node_t *n = (trie_node_t *) m_alloc(sizeof(trie_node_t));
+	memset(n, 0, sizeof(trie_node_t));
+	n->label = (char *) m_alloc(len + 1);
+	memcpy(n->label, label, len);
+	n->label[len] = '\0';
+	n->len = len;
+	return n;
+	}
+
+//
+static void trie_node_free(trie_node_t *n) {
+	for ( int i = 0; i < n->count; i ++ ) {
+		trie_node_free(n->child[i]);
+		m_free(n->child[i]);
+		}
+	if ( n->child ) m_free(n->child);
+	if ( n->label ) m_free(n->label);
+	}
+
+// binary search of the child that starts with 'c'; returns its index or
+// the position to insert it (negative, -pos-1)
+static int trie_find(const trie_node_t *n, unsigned char c) {
+	int lo = 0, hi = n->count - 1, mid;
+	while ( lo <= hi ) {
+		mid = (lo + hi) / 2;
+		unsigned char m = (unsigned char) n->child[mid]->label[0];
+		if ( m == c ) return mid;
+		if ( m < c ) lo = mid + 1; else hi = mid - 1;
+		}
+	return -lo - 1;
+	}
+
+//
+static void trie_add_child(trie_node_t *n, int pos, trie_node_t *c) {
+	if ( n->count == n->alloc ) {
+		n->alloc = ( n->alloc ) ? n->alloc * 2 : 4;
+		n->child = (trie_node_t **) m_realloc(n->child, sizeof(trie_node_t *) * n->alloc);
+		}
+	memmove(n->child + pos + 1, n->child + pos, sizeof(trie_node_t *) * (n->count - pos));
+	n->child[pos] = c;
+	n->count ++;
+	}
+
+//
+trie_t *trie_create() {
+	trie_t *t = (trie_t *) m_alloc(sizeof(trie_t));
+	memset(t, 0, sizeof(trie_t));
+	return t;
+	}
+
+//
+trie_t *trie_free(trie_t *t) {
+	if ( t ) {
+		trie_node_free(&t->root);
+		m_free(t);
+		}
+	return NULL;
+	}
+
+// add the 'key'
+void trie_insert(trie_t *t, const char *key) {
+	trie_node_t *n = &t->root, *c, *mid;
+	size_t	klen = strlen(key), i;
+	int		pos;
+
+	while ( klen ) {
+		if ( (pos = trie_find(n, *key)) < 0 ) { // new edge
+			trie_add_child(n, -pos - 1, (c = trie_node(key, klen)));
+			c->term = true;
+			return;
+			}
+		c = n->child[pos];
+		for ( i = 1; i < c->len && i < klen && c->label[i] == key[i]; i ++ );
+		if ( i < c->len ) { // split the edge at 'i'
+			mid = trie_node(c->label, i);
+			memmove(c->label, c->label + i, c->len - i + 1);
+			c->len -= i;
+			trie_add_child(mid, 0, c);
+			n->child[pos] = mid;
+			c = mid;
+			}
+		n = c;
+		key += i;
+		klen -= i;
+		}
+	n->term = true;
+	}
+
+// walk the subtree, 'buf' has the key of 'n'
+static int trie_walk(const trie_node_t *n, char *buf, size_t len, void (*func)(const char *, void *), void *arg, int max, int found) {
+	if ( n->term ) {
+		func(buf, arg);
+		found ++;
+		}
+	for ( int i = 0; i < n->count && (max == 0 || found < max); i ++ ) {
+		const trie_node_t *c = n->child[i];
+		if ( len + c->len >= PATH_MAX )
+			continue;
+		memcpy(buf + len, c->label, c->len + 1);
+		found = trie_walk(c, buf, len + c->len, func, arg, max, found);
+		}
+	buf[len] = '\0';
+	return found;
+	}
+
+// calls 'func' for each key that starts with 'prefix'
+int trie_complete(const trie_t *t, const char *prefix, void (*func)(const char *key, void *arg), void *arg, int max) {
+	const trie_node_t *n = &t->root, *c;
+	char	buf[PATH_MAX];
+	size_t	plen = strlen(prefix), len = 0, i;
+	int		pos;
+
+	while ( len < plen ) {
+		if ( (pos = trie_find(n, prefix[len])) < 0 )
+			return 0;
+		c = n->child[pos];
+		for ( i = 1; i < c->len && len + i < plen && c->label[i] == prefix[len + i]; i ++ );
+		if ( len + i < plen && i < c->len ) // mismatch
+			return 0;
+		if ( len + c->len >= PATH_MAX )
+			return 0;
+		memcpy(buf + len, c->label, c->len);
+		len += c->len;
+		n = c;
+		}
+	buf[len] = '\0';
+	return trie_walk(n, buf, len, func, arg, max, 0);
+	}
@@ -0,0 +1,50 @@
+/*
+ *	compressed prefix trie
+ * 
+ *	Copyright (C) 2017-2022 Nicholas Christopoulos.
+ *
+ *	This is free software: you can redistribute it and/or modify it under
+ *	the terms of the GNU General Public License as published by the
+ *	Free Software Foundation, either version 3 of the License, or (at your
+ *	option) any later version.
+ *
+ *	It is distributed in the hope that it will be useful, but WITHOUT ANY
+ *	WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *	FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *	for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with it. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * 	Written by Nicholas Christopoulos <nereus@freemail.gr>
+ */
+
+
+#if !defined(__TRIE_H__)
+#define __TRIE_H__
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// radix tree of strings; each edge holds a part of the key and the
+// children of a node are sorted by their first byte.
+typedef struct trie_s trie_t;
+
+trie_t *trie_create();
+trie_t *trie_free(trie_t *t);
+
+// add the 'key'
+void trie_insert(trie_t *t, const char *key);
+
+// calls 'func' for each key that starts with 'prefix', in order;
+// stops after 'max' keys (0 = all). returns the number of keys.
+int trie_complete(const trie_t *t, const char *prefix, void (*func)(const char *key, void *arg), void *arg, int max);
+
+#if defined(__cplusplus)
+	}
+#endif
+
+#endif